@@ -0,0 +1,316 @@
+// bench.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+// Throughput benchmarks for the parse and fit hot paths.  Synthetic CSV
+// datasets are generated once per size and reused; every phase reports
+// points/sec and GB/s so regressions show up across versions.  The
+// default sizes include 10M points, where the robust fit is measured.
+//
+// Usage: bench [-n] -d [data_dir] -c [regression_binary] [points ...]
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "regression.h"
+
+using namespace std;
+using namespace hedger;
+
+// Minimum time spent repeating a phase, so small sizes measure stably
+static const double MIN_SECONDS = 0.25;
+
+// Keeps results live so the compiler can not drop the work
+static volatile double sink;
+
+static double now()
+{
+  return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// timeIt
+// Run a phase until MIN_SECONDS have passed.
+// Exit: mean seconds per run
+template <typename F>
+static double timeIt(F phase)
+{
+  int runs = 0;
+  double start = now(), elapsed;
+  do {
+    phase();
+    runs++;
+    elapsed = now() - start;
+  } while (elapsed < MIN_SECONDS);
+  return elapsed / runs;
+}
+
+static void report(size_t points, const char *phase, double seconds, double bytes)
+{
+  printf("%12zu  %-14s %12.6f  %12.2f  %8.3f\n",
+      points, phase, seconds, points / seconds / 1e6, bytes / seconds / 1e9);
+  fflush(stdout);
+}
+
+// generate
+// Write points noisy samples of y = 3x + 7 as x,y lines, unless a file of
+// that size is already there.
+// Entry: filename
+//        # of points
+// Exit: true on success
+static bool generate(const string &file, size_t points)
+{
+  struct stat st;
+  if (!stat(file.c_str(), &st) && st.st_size > 0) {
+    return true;
+  }
+  string partial = file + ".tmp";
+  FILE *f = fopen(partial.c_str(), "w");
+  if (!f) {
+    return false;
+  }
+  vector<char> buffer(1 << 20);
+  setvbuf(f, &buffer[0], _IOFBF, buffer.size());
+  uint64_t state = 88172645463325252ULL;
+  for (size_t i = 0; i < points; i++) {
+    // xorshift64 noise in [-0.5, 0.5)
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    double noise = (double) (state >> 11) / (double) (1ULL << 53) - 0.5;
+    double x = (double) (i % 1000000) * 0.001;
+    fprintf(f, "%.6f,%.6f\n", x, 3.0 * x + 7.0 + noise);
+  }
+  bool ok = !ferror(f);
+  ok &= !fclose(f);
+  return ok && !rename(partial.c_str(), file.c_str());
+}
+
+// runCli
+// Run the command line tool on a file with its output discarded.
+// Exit: true if it exited successfully
+static bool runCli(const char *binary, const char *mode, const char *file)
+{
+  pid_t pid = fork();
+  if (0 == pid) {
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    execl(binary, binary, mode, file, (char *) NULL);
+    _exit(127);
+  }
+  int status = 0;
+  return pid > 0 && waitpid(pid, &status, 0) == pid &&
+    WIFEXITED(status) && 0 == WEXITSTATUS(status);
+}
+
+// datasetName
+// Exit: path of the generated dataset of a given size
+static string datasetName(const char *dataDir, size_t points)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "/points-%zu.csv", points);
+  return string(dataDir) + name;
+}
+
+static void benchmark(const char *dataDir, const char *cli, size_t points)
+{
+  string file = datasetName(dataDir, points);
+  if (!generate(file, points)) {
+    fprintf(stderr, "Could not generate '%s'\n", file.c_str());
+    exit(-1);
+  }
+  struct stat st;
+  stat(file.c_str(), &st);
+  double fileBytes = st.st_size;
+  double dataBytes = points * 2.0 * sizeof(double);
+
+  DataSet data;
+  double seconds = timeIt([&]() {
+    if (!parseFile(file.c_str(), &data)) {
+      fprintf(stderr, "Could not parse '%s'\n", file.c_str());
+      exit(-1);
+    }
+  });
+  report(points, "parseFile", seconds, fileBytes);
+
+  // A fresh data set per parse, as a server would; the arena keeps its
+  // blocks so only the first run reaches malloc
+  Arena arena;
+  seconds = timeIt([&]() {
+    DataSet fresh(&arena);
+    if (!parseFile(file.c_str(), &fresh)) {
+      fprintf(stderr, "Could not parse '%s'\n", file.c_str());
+      exit(-1);
+    }
+    arena.reset();
+  });
+  report(points, "parse/arena", seconds, fileBytes);
+
+  vector<DataPoint> interleaved(data.size());
+  for (size_t i = 0; i < data.size(); i++) {
+    interleaved[i].x = data.x()[i];
+    interleaved[i].y = data.y()[i];
+  }
+
+  seconds = timeIt([&]() {
+    double x, y, xSquared, xy;
+    getSums(&interleaved[0], interleaved.size(), &x, &y, &xSquared, &xy);
+    sink = x + y + xSquared + xy;
+  });
+  report(points, "getSums", seconds, dataBytes);
+
+  seconds = timeIt([&]() {
+    double x, y, xSquared, xy;
+    getSums(data, &x, &y, &xSquared, &xy);
+    sink = x + y + xSquared + xy;
+  });
+  report(points, "getSums/soa", seconds, dataBytes);
+
+  seconds = timeIt([&]() {
+    double b, m;
+    getBestFit(&interleaved[0], interleaved.size(), &b, &m);
+    sink = b + m;
+  });
+  report(points, "getBestFit", seconds, dataBytes);
+
+  // About nine O(N log N) merge passes over the points, against one
+  // streaming pass for the OLS fit: expect it two to three orders of
+  // magnitude below getBestFit, e.g. ~0.5 Mpoints/s at 10M points.
+  seconds = timeIt([&]() {
+    double b, m;
+    getTheilSen(data, &b, &m);
+    sink = b + m;
+  });
+  report(points, "getTheilSen", seconds, dataBytes);
+
+  // Small integer grid, so millions of pairs share the median slope
+  DataSet tied;
+  for (size_t i = 0; i < data.size(); i++) {
+    tied.add((double) (i * 7 % 10), (double) (i / 10 * 3 % 5));
+  }
+  seconds = timeIt([&]() {
+    double b, m;
+    getTheilSen(tied, &b, &m);
+    sink = b + m;
+  });
+  report(points, "theilSen/tied", seconds, dataBytes);
+
+  // Two predictors, one an epoch timestamp far from 0, the other a
+  // scrambled grid in [0, 1); checked as well as timed, since raw normal
+  // equations lose the timestamp to cancellation
+  const double EPOCH = 1.7e9;
+  vector<double> rows(data.size() * 3);
+  for (size_t i = 0; i < data.size(); i++) {
+    double t = 0.5 * i, x = (double) (i * 7919 % 1009) / 1009.0;
+    rows[3 * i] = EPOCH + t;
+    rows[3 * i + 1] = x;
+    rows[3 * i + 2] = 7.0 + 2.5 * t + 4.0 * x;
+  }
+  MultipleFit multiple;
+  seconds = timeIt([&]() {
+    if (!fitMultiple(rows.data(), data.size(), 2, 0, &multiple)) {
+      fprintf(stderr, "fitMultiple failed on offset predictors\n");
+      exit(-1);
+    }
+    sink = multiple.beta[0];
+  });
+  double want[] = { 7.0 - 2.5 * EPOCH, 2.5, 4.0 };
+  for (size_t k = 0; k < 3; k++) {
+    double scale = 0 == k ? 2.5 * EPOCH : 1.0;
+    if (!(fabs(multiple.beta[k] - want[k]) <= 1e-6 * scale)) {
+      fprintf(stderr, "fitMultiple on offset predictors: beta%zu=%.17g, want %.17g\n",
+          k, multiple.beta[k], want[k]);
+      exit(-1);
+    }
+  }
+  report(points, "multiple/epoch", seconds, 3 * dataBytes / 2);
+
+  if (cli) {
+    seconds = timeIt([&]() {
+      if (!runCli(cli, "-f", file.c_str())) {
+        fprintf(stderr, "'%s -f %s' failed\n", cli, file.c_str());
+        exit(-1);
+      }
+    });
+    report(points, "cli -f", seconds, fileBytes);
+  }
+}
+
+static void printUsage()
+{
+  printf("bench\n");
+  printf("Parse and fit throughput benchmarks.\n");
+  printf("\nOptions:\n");
+  printf("  -d Directory for generated datasets (default .)\n");
+  printf("  -c regression binary to time end to end\n");
+  printf("  -n Only generate the datasets\n");
+  printf("\nUsage:\n");
+  printf(" bench [-n] [-d data_dir] [-c regression] [points ...]\n");
+}
+
+int main(int argc, const char *argv[])
+{
+  const char *dataDir = ".";
+  const char *cli = NULL;
+  bool generateOnly = false;
+  vector<size_t> sizes;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+      dataDir = argv[++i];
+    } else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+      cli = argv[++i];
+    } else if (!strcmp(argv[i], "-n")) {
+      generateOnly = true;
+    } else if (strtoull(argv[i], NULL, 10) > 0) {
+      sizes.push_back(strtoull(argv[i], NULL, 10));
+    } else {
+      printUsage();
+      return 1;
+    }
+  }
+  if (sizes.empty()) {
+    sizes.push_back(1000);
+    sizes.push_back(1000000);
+  }
+
+  if (generateOnly) {
+    for (size_t i = 0; i < sizes.size(); i++) {
+      if (!generate(datasetName(dataDir, sizes[i]), sizes[i])) {
+        fprintf(stderr, "Could not generate datasets in '%s'\n", dataDir);
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  printf("%12s  %-14s %12s  %12s  %8s\n", "points", "phase", "seconds", "Mpoints/s", "GB/s");
+  for (size_t i = 0; i < sizes.size(); i++) {
+    benchmark(dataDir, cli, sizes[i]);
+  }
+  return 0;
+}
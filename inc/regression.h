@@ -0,0 +1,731 @@
+// regression.h
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+// Public interface to the regression engine: data containers, the
+// one-pass sums and the fits built on them, and file ingest.
+//
+
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hedger {
+  // BasicDataPoint
+  // An {x,y} point of data type T; DataPoint is the double precision one.
+  template <typename T>
+  struct BasicDataPoint {
+    T x;
+    T y;
+  };
+  typedef BasicDataPoint<double> DataPoint;
+  static_assert(sizeof(DataPoint) == 2 * sizeof(double),
+      "sums kernels read DataPoint arrays as interleaved doubles");
+
+  // BasicSums
+  // Running sigmas over a set of {x,y} points, accumulated in type A;
+  // everything the best fit calculations need, so points can be folded in
+  // as they arrive.  Sums is the double precision one.
+  template <typename A>
+  struct BasicSums {
+    BasicSums() : n(0), x(0), y(0), xSquared(0), xy(0), ySquared(0) {}
+    void add(A px, A py)
+    {
+      n++;
+      x += px;
+      y += py;
+      xSquared += px * px;
+      xy += px * py;
+      ySquared += py * py;
+    }
+    void remove(A px, A py)
+    {
+      n--;
+      x -= px;
+      y -= py;
+      xSquared -= px * px;
+      xy -= px * py;
+      ySquared -= py * py;
+    }
+    void merge(const BasicSums &other)
+    {
+      n += other.n;
+      x += other.x;
+      y += other.y;
+      xSquared += other.xSquared;
+      xy += other.xy;
+      ySquared += other.ySquared;
+    }
+    size_t n;
+    A x;
+    A y;
+    A xSquared;
+    A xy;
+    A ySquared;
+  };
+  typedef BasicSums<double> Sums;
+
+  // WeightedSums
+  // Running sigmas over {x,y,w} points for weighted least squares: Σw and
+  // the w-weighted Σx, Σy, Σx², Σxy and Σy².
+  struct WeightedSums {
+    WeightedSums() : n(0), w(0), x(0), y(0), xSquared(0), xy(0), ySquared(0) {}
+    void add(double px, double py, double pw)
+    {
+      double wx = pw * px, wy = pw * py;
+      n++;
+      w += pw;
+      x += wx;
+      y += wy;
+      xSquared += wx * px;
+      xy += wx * py;
+      ySquared += wy * py;
+    }
+    void merge(const WeightedSums &other)
+    {
+      n += other.n;
+      w += other.w;
+      x += other.x;
+      y += other.y;
+      xSquared += other.xSquared;
+      xy += other.xy;
+      ySquared += other.ySquared;
+    }
+    size_t n;
+    double w;
+    double x;
+    double y;
+    double xSquared;
+    double xy;
+    double ySquared;
+  };
+
+  // Arena
+  // Bump allocator for fits that come and go in batches.  Blocks are
+  // kept across reset(), so once a process has seen its largest batch,
+  // later batches allocate without touching malloc or its locks.  Not
+  // thread safe; give each thread its own arena.
+  class Arena {
+  public:
+    static const size_t ALIGNMENT = 64;
+    static const size_t BLOCK_SIZE = 1 << 20;
+
+    explicit Arena(size_t blockSize = BLOCK_SIZE) :
+      blockSize_(blockSize), current_(0), used_(0) {}
+    ~Arena();
+
+    // allocate
+    // Entry: bytes wanted
+    // Exit: ALIGNMENT aligned memory valid until reset, NULL if out of memory
+    void *allocate(size_t bytes);
+
+    // reset
+    // Release everything allocated since the last reset, keeping the
+    // blocks for reuse.  Containers using the arena must be done with it.
+    void reset() { current_ = 0; used_ = 0; }
+
+    // Bytes held in blocks, used or not
+    size_t reserved() const;
+
+  private:
+    Arena(const Arena &);
+    Arena &operator=(const Arena &);
+
+    struct Block {
+      char *data;
+      size_t size;
+    };
+    std::vector<Block> blocks_;
+    size_t blockSize_;
+    size_t current_;  // block being carved
+    size_t used_;     // bytes carved from it
+  };
+
+  // DataSet
+  // Columnar {x,y} storage: separate, cache line aligned x and y arrays
+  // that grow geometrically.  Passes that only need x never pull y through
+  // the cache, and both columns load straight into vector registers.
+  // Given an arena, the columns come from it and are never freed; the
+  // arena's reset reclaims them.
+  class DataSet {
+  public:
+    static const size_t ALIGNMENT = 64;
+
+    DataSet() : x_(NULL), y_(NULL), size_(0), capacity_(0), arena_(NULL) {}
+    explicit DataSet(Arena *arena) :
+      x_(NULL), y_(NULL), size_(0), capacity_(0), arena_(arena) {}
+    ~DataSet() { release(); }
+
+    DataSet(DataSet &&other)
+      : x_(other.x_), y_(other.y_), size_(other.size_), capacity_(other.capacity_),
+        arena_(other.arena_)
+    {
+      other.x_ = other.y_ = NULL;
+      other.size_ = other.capacity_ = 0;
+    }
+
+    DataSet &operator=(DataSet &&other)
+    {
+      if (this != &other) {
+        release();
+        x_ = other.x_;
+        y_ = other.y_;
+        size_ = other.size_;
+        capacity_ = other.capacity_;
+        arena_ = other.arena_;
+        other.x_ = other.y_ = NULL;
+        other.size_ = other.capacity_ = 0;
+      }
+      return *this;
+    }
+
+    // reserve
+    // Make room for at least capacity points.
+    // Exit: false if the columns could not be allocated
+    bool reserve(size_t capacity)
+    {
+      if (capacity <= capacity_) {
+        return true;
+      }
+      void *x = NULL, *y = NULL;
+      if (arena_) {
+        x = arena_->allocate(capacity * sizeof(double));
+        y = arena_->allocate(capacity * sizeof(double));
+        if (!x || !y) {
+          return false;
+        }
+      } else {
+        if (posix_memalign(&x, ALIGNMENT, capacity * sizeof(double))) {
+          return false;
+        }
+        if (posix_memalign(&y, ALIGNMENT, capacity * sizeof(double))) {
+          free(x);
+          return false;
+        }
+      }
+      if (size_) {
+        memcpy(x, x_, size_ * sizeof(double));
+        memcpy(y, y_, size_ * sizeof(double));
+      }
+      if (!arena_) {
+        free(x_);
+        free(y_);
+      }
+      x_ = static_cast<double *>(x);
+      y_ = static_cast<double *>(y);
+      capacity_ = capacity;
+      return true;
+    }
+
+    // add
+    // Append a point, growing the columns as needed.
+    // Exit: false if the columns could not be grown
+    bool add(double x, double y)
+    {
+      if (size_ == capacity_ && !reserve(capacity_ ? capacity_ * 2 : 1024)) {
+        return false;
+      }
+      x_[size_] = x;
+      y_[size_] = y;
+      size_++;
+      return true;
+    }
+
+    // swapAxes
+    // Exchange the x and y columns.
+    void swapAxes() { std::swap(x_, y_); }
+
+    void clear() { size_ = 0; }
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    double *x() { return x_; }
+    double *y() { return y_; }
+    const double *x() const { return x_; }
+    const double *y() const { return y_; }
+
+  private:
+    DataSet(const DataSet &);
+    DataSet &operator=(const DataSet &);
+
+    void release()
+    {
+      if (!arena_) {
+        free(x_);
+        free(y_);
+      }
+      x_ = y_ = NULL;
+      size_ = capacity_ = 0;
+    }
+
+    double *x_;
+    double *y_;
+    size_t size_;
+    size_t capacity_;
+    Arena *arena_;    // owner of the columns, NULL for the heap
+  };
+
+  // Fit
+  // Everything reported about a data set, from a single pass over it.
+  struct Fit {
+    Sums sums;
+    double xMean;   // x̄
+    double yMean;   // ȳ
+    double m;       // slope
+    double b;       // baseline
+    double yAtMean; // m x̄ + b
+    double r2;                // coefficient of determination
+    double residualVariance;  // s² = Σ(y - mx - b)² / (N - 2)
+    double slopeError;        // standard error of m
+    double baselineError;     // standard error of b
+  };
+
+  // OnlineFit
+  // Incremental regression over a changing set of points.  Rather than raw
+  // sigmas it keeps the means and centered co-moments Σ(x-x̄)² and
+  // Σ(x-x̄)(y-ȳ), updated Welford style, so long streams don't suffer the
+  // cancellation in N Σx² − (Σx)².  Every operation is O(1).
+  class OnlineFit {
+  public:
+    OnlineFit() : n_(0), xMean_(0.0), yMean_(0.0), xM2_(0.0), yM2_(0.0), coMoment_(0.0) {}
+
+    void add(double x, double y);
+    // Remove a point previously added
+    void remove(double x, double y);
+    // Fold in every point of another accumulator
+    void merge(const OnlineFit &other);
+    void clear() { *this = OnlineFit(); }
+
+    size_t size() const { return n_; }
+    double xMean() const { return xMean_; }
+    double yMean() const { return yMean_; }
+    double slope() const { return coMoment_ / xM2_; }
+    double baseline() const { return yMean_ - slope() * xMean_; }
+
+    // Equivalent raw sums, and the full fit report
+    Sums sums() const;
+    void getFit(Fit *fit) const;
+
+  private:
+    size_t n_;
+    double xMean_;
+    double yMean_;
+    double xM2_;      // Σ(x-x̄)²
+    double yM2_;      // Σ(y-ȳ)²
+    double coMoment_; // Σ(x-x̄)(y-ȳ)
+  };
+
+  // WindowFit
+  // Regression over the last K points of a stream.  Points live in a ring
+  // buffer and the four sigmas are updated as each point enters and the
+  // oldest leaves, so every step is O(1).  To bound floating point drift
+  // from the subtractions the sums are recomputed from the ring every
+  // resumInterval steps (default K), keeping the amortized cost O(1).
+  class WindowFit {
+  public:
+    explicit WindowFit(size_t window, size_t resumInterval = 0);
+
+    void add(double x, double y);
+    void clear();
+
+    bool full() const { return count_ == ring_.size(); }
+    size_t size() const { return count_; }
+    size_t window() const { return ring_.size(); }
+    const Sums &sums() const { return sums_; }
+    void getBestFit(double *b, double *m) const;
+    void getFit(Fit *fit) const;
+
+  private:
+    void resum();
+
+    std::vector<DataPoint> ring_;
+    size_t head_;           // next slot to write
+    size_t count_;
+    size_t resumInterval_;
+    size_t sinceResum_;
+    Sums sums_;
+  };
+
+  // ColumnFile
+  // Binary columnar data file, read by mapping it; nothing is parsed.
+  // Layout, all little-endian:
+  //   ColumnFileHeader
+  //   x column, count values of the header's type
+  //   y column, count values of the header's type
+  enum ColumnType {
+    COLUMN_FLOAT64 = 0,
+    COLUMN_FLOAT32 = 1
+  };
+
+  struct ColumnFileHeader {
+    char magic[8];      // COLUMN_FILE_MAGIC
+    uint32_t version;   // COLUMN_FILE_VERSION
+    uint32_t type;      // ColumnType
+    uint64_t count;     // # of points
+    uint64_t reserved;
+  };
+  static_assert(sizeof(ColumnFileHeader) == 32, "column file header layout");
+
+  static const char COLUMN_FILE_MAGIC[8] = { 'R', 'E', 'G', 'R', 'C', 'O', 'L', '\0' };
+  static const uint32_t COLUMN_FILE_VERSION = 1;
+
+  class ColumnFile {
+  public:
+    ColumnFile() : map_(NULL), mapSize_(0), header_(NULL) {}
+    ~ColumnFile() { close(); }
+
+    // Map and validate a column file; false if it is not one
+    bool open(const char *file);
+    void close();
+
+    ColumnType type() const { return (ColumnType) header_->type; }
+    size_t size() const { return header_->count; }
+    // Column pointers for the file's type
+    const double *x64() const;
+    const double *y64() const;
+    const float *x32() const;
+    const float *y32() const;
+    // Sums over the mapped columns
+    void getSums(Sums *sums) const;
+    // Readahead for the mapping: sequential for whole column passes,
+    // random for sparse reads that should not pull in skipped rows
+    void setAccess(bool sequential) const;
+
+    // Check whether a file starts with the column file magic
+    static bool isColumnFile(const char *file);
+    // Write a data set as a column file
+    static bool write(const char *file, const DataSet &data, ColumnType type);
+
+  private:
+    ColumnFile(const ColumnFile &);
+    ColumnFile &operator=(const ColumnFile &);
+
+    const void *column(int index) const;
+
+    void *map_;
+    size_t mapSize_;
+    const ColumnFileHeader *header_;
+  };
+
+  // Sums (sigmas) Σx, Σy, Σx² and Σxy over interleaved or columnar data
+  void getSums(DataPoint *data, size_t size,
+      double *x, double *y, double *xSquared, double *xy);
+  void getSums(const DataSet &data,
+      double *x, double *y, double *xSquared, double *xy);
+
+  // Sums, best fit and least squares for data type T accumulated in type
+  // A, each combination with its own kernels.  Instantiated for
+  //   <float, float>  <float, double>  <double, double>
+  //   <double, long double>  <long double, long double>
+  template <typename T, typename A>
+  void getSums(const BasicDataPoint<T> *data, size_t size, BasicSums<A> *sums);
+  template <typename T, typename A>
+  void getSums(const T *xs, const T *ys, size_t size, BasicSums<A> *sums);
+
+  // x mean (x̄)
+  double getMean(DataPoint *data, size_t size);
+  double getMean(const DataSet &data);
+
+  // Best slope m and baseline b
+  template <typename A>
+  void getBestFit(const BasicSums<A> &sums, A *b, A *m);
+  template <typename T, typename A>
+  void getBestFit(const BasicDataPoint<T> *data, size_t size, A *b, A *m);
+  void getBestFit(const DataSet &data, double *b, double *m);
+
+  // Sums, means, m, b, the prediction at x̄ and the fit statistics from
+  // one pass
+  void getFit(const Sums &sums, Fit *fit);
+  void getFit(DataPoint *data, size_t size, Fit *fit);
+  void getFit(const DataSet &data, Fit *fit);
+  void getFitStatistics(size_t n, double weight, double sxx, double syy, double sxy, Fit *fit);
+
+  // Compensated sums whose bits are the same for any thread count (0 for
+  // all cores): fixed chunks summed with error terms, combined in a fixed
+  // tree.  More accurate than getSums on large N, at some cost in speed
+  void getSumsReproducible(const DataSet &data, unsigned threads, Sums *sums);
+
+  // Weighted sums over x, y and weight columns, with their own kernels
+  void getWeightedSums(const double *xs, const double *ys, const double *ws,
+      size_t size, WeightedSums *sums);
+  // Stream a file of x,y,w triples into weighted sums; false if unreadable
+  bool streamWeightedFile(const char *file, WeightedSums *sums);
+  // Weighted least squares fit; fit->sums holds n and the weighted sigmas
+  void getFit(const WeightedSums &sums, Fit *fit);
+
+  // Ordinary least squares intercept a and slope b
+  template <typename A>
+  void getLeastSquares(const BasicSums<A> &sums, A *a, A *b);
+  template <typename T, typename A>
+  void getLeastSquares(const BasicDataPoint<T> *data, size_t size, A *a, A *b);
+  void getLeastSquares(const DataSet &data, double *a, double *b);
+
+  // Parse a non-digit-separated file of alternating x and y values into
+  // a DataPoint array, or into a data set; empty/false on failure
+  std::unique_ptr<DataPoint[]> parseFile(const char *file, size_t *size);
+  bool parseFile(const char *file, DataSet *data);
+
+  // Fields
+  // Where x and y sit in each line of a delimited text file, for exports
+  // with header rows, timestamps or extra columns.  Fields count from 0;
+  // fields that are not selected are skipped over, never parsed.
+  struct Fields {
+    Fields() : x(0), y(1), header(0), delimiter(',') {}
+    size_t x;
+    size_t y;
+    size_t header;    // leading lines to skip
+    char delimiter;
+  };
+
+  // parseFile and streamFile over the selected fields of each line; lines
+  // without a number in both fields are skipped
+  bool parseFile(const char *file, const Fields &fields, DataSet *data);
+  bool streamFile(const char *file, const Fields &fields, Sums *sums);
+
+  // Accumulate sums over a file without storing points, on one thread
+  // or across several; "-" reads standard input
+  bool streamFile(const char *file, bool swap, Sums *sums);
+  bool sumFileParallel(const char *file, bool swap, unsigned threads, Sums *sums);
+  // The streamFile sums with reading, tokenizing and summing overlapped on
+  // three threads; streamFile does this by itself for pipes on multicore
+  // hosts
+  bool streamFilePipelined(const char *file, bool swap, Sums *sums);
+
+  // GroupFit
+  // Fit of one series in a grouped (key,x,y) input.
+  struct GroupFit {
+    std::string key;
+    Fit fit;
+  };
+
+  // Fit every series of a file of key,x,y lines in one parallel pass;
+  // results are sorted by key.  0 threads means one per hardware thread
+  bool fitGroups(const char *file, unsigned threads, std::vector<GroupFit> *fits);
+
+  // PowerSums
+  // Σtᵏ for k ≤ 2K, Σtᵏy for k ≤ K and Σy² with t = x - shift, everything
+  // a degree K polynomial fit needs, from one pass.  The shift is the
+  // first x added unless set beforehand, so x far from 0 does not cost
+  // the high powers their digits.  Points are taken LANES at a time with
+  // a lane of accumulators each, so the power ladder of every lane
+  // vectorizes; lanes are combined when read.
+  class PowerSums {
+  public:
+    static const size_t LANES = 4;
+
+    explicit PowerSums(size_t degree);
+
+    // setShift
+    // Take powers about shift instead of the first x; ignored once points
+    // have been added
+    void setShift(double shift);
+
+    void add(double x, double y) { add(&x, &y, 1); }
+    void add(const double *x, const double *y, size_t size);
+    // Combine with sums over other points, taken about any shift
+    void merge(const PowerSums &other);
+    void clear();
+
+    size_t degree() const { return degree_; }
+    size_t size() const { return n_; }
+    double shift() const { return shift_; }
+    double x(size_t k) const;     // Σtᵏ, k ≤ 2K
+    double xy(size_t k) const;    // Σtᵏy, k ≤ K
+    double yy() const;            // Σy²
+
+  private:
+    double lanes(const std::vector<double> &sums, size_t k) const;
+
+    size_t degree_;
+    size_t n_;
+    double shift_;
+    bool shifted_;                // shift_ is fixed
+    std::vector<double> x_;       // (2K + 1) × LANES
+    std::vector<double> xy_;      // (K + 1) × LANES
+    std::vector<double> yy_;      // LANES
+  };
+
+  // NormalEquations
+  // Accumulates the Gram matrix of augmented rows z = [1, t₁ … t_p, y]
+  // with tⱼ = xⱼ - shiftⱼ: XᵀX with an intercept column, Xᵀy and yᵀy in
+  // one symmetric matrix.  The shifts are the first row added unless set
+  // beforehand, so predictors far from 0, such as timestamps, keep their
+  // digits.  Rows are buffered into blocks and folded in with a rank-k
+  // update whose inner loop runs along contiguous memory, so it
+  // vectorizes.
+  class NormalEquations {
+  public:
+    static const size_t BLOCK_ROWS = 256;
+
+    explicit NormalEquations(size_t predictors);
+    // Polynomial fit as regression on t, t², … tᴷ, t = x - sums.shift()
+    explicit NormalEquations(const PowerSums &sums);
+
+    // setShift
+    // Take each predictor about shift[j] instead of the first row;
+    // ignored once rows have been added
+    void setShift(const double *shift);
+
+    // add
+    // Entry: p predictor values
+    //        response
+    void add(const double *x, double y);
+    // Combine with equations over other rows, taken about any shift
+    void merge(const NormalEquations &other);
+    void clear();
+
+    // solve
+    // Solve XᵀX β = Xᵀy by Cholesky factorization, in the shifted
+    // predictors, then move the intercept back to unshifted ones.
+    // Entry: pointer to destination coefficients: intercept, then one
+    //        per predictor
+    // Exit: false if XᵀX is singular, e.g. collinear predictors or fewer
+    //       rows than coefficients
+    bool solve(std::vector<double> *beta) const;
+
+    size_t predictors() const { return p_; }
+    size_t size() const { flush(); return n_; }
+    const std::vector<double> &shift() const { return shift_; }
+    // Gram entry of augmented columns i ≤ j; 0 is the intercept, p + 1 y
+    double gram(size_t i, size_t j) const { flush(); return gram_[i * (p_ + 2) + j]; }
+
+  private:
+    void flush() const;
+
+    size_t p_;
+    mutable size_t n_;
+    std::vector<double> shift_;           // p predictor shifts
+    bool shifted_;                        // shift_ is fixed
+    mutable std::vector<double> gram_;    // (p + 2)², upper triangle used
+    mutable std::vector<double> block_;   // BLOCK_ROWS augmented rows
+    mutable size_t pending_;              // rows waiting in block_
+  };
+
+  // MultipleFit
+  // Multiple linear regression y = β₀ + β₁x₁ + … + β_p x_p.
+  struct MultipleFit {
+    size_t n;                   // # of rows
+    std::vector<double> beta;   // intercept, then one per predictor
+  };
+
+  // Fit rows held in memory, row major, each p predictors then y, or
+  // rows of a file, one per line, skipping lines with fewer than p + 1
+  // numbers.  Rows are split across threads, 0 for one per hardware thread
+  bool fitMultiple(const double *rows, size_t count, size_t predictors,
+      unsigned threads, MultipleFit *fit);
+  bool fitMultiple(const char *file, size_t predictors, unsigned threads, MultipleFit *fit);
+
+  // Power sums over a data set, about its mean x unless sums already
+  // holds points, or over a file in one streaming pass; "-" reads
+  // standard input
+  void getPowerSums(const DataSet &data, PowerSums *sums);
+  bool streamPowerSums(const char *file, PowerSums *sums);
+
+  // Coefficients c₀ … c_K of y = c₀ + c₁x + … + c_K xᴷ; false if the
+  // system is singular, e.g. fewer than K + 1 distinct x.  The fit is
+  // solved in powers of x - shift, so conditioning depends on the spread
+  // of x and K rather than on how far x is from 0
+  bool fitPolynomial(const PowerSums &sums, std::vector<double> *coefficients);
+
+  // Theil–Sen robust fit: m is the median of the pairwise slopes (pairs
+  // with equal x skipped) and b the median of y - m x.  Expected
+  // O(N log N) time and O(N) memory; false with fewer than two distinct x
+  bool getTheilSen(const DataSet &data, double *b, double *m);
+
+  // SampledFit
+  // Fit of a uniform sample of the input, with 95% confidence intervals
+  // for the fit of the whole input.  The intervals come from the sample's
+  // standard errors, a t quantile and the finite population correction,
+  // so they close to nothing as the sample approaches every row.
+  struct SampledFit {
+    Fit fit;              // over the sample; fit.sums.n points
+    size_t rows;          // points in the whole input
+    double bInterval;     // b ± bInterval
+    double mInterval;     // m ± mInterval
+  };
+
+  // Reservoir sample of up to size points of a text file, read in one
+  // pass; "-" reads standard input.  False if unreadable
+  bool sampleFile(const char *file, size_t size, SampledFit *fit);
+  // Systematic sample of at least size rows of a column file from a
+  // random start, reading only the sampled rows.  While the m interval is
+  // wider than target × |m| the stride is halved, adding the rows between
+  // those already read; target 0 stops after the first sample.  Rows
+  // periodic at a power of two stride can bias the sample
+  void sampleColumns(const ColumnFile &columns, size_t size, double target, SampledFit *fit);
+
+  // Hand every {x,y} point of a file to a callback as it is parsed
+  typedef void (*PointCallback)(double x, double y, void *context);
+  bool streamPoints(const char *file, bool swap, PointCallback callback, void *context);
+  bool streamPoints(const char *file, const Fields &fields, PointCallback callback, void *context);
+
+  // Fit server protocol.  A client sends any number of requests on one
+  // connection without waiting; each gets one response, in order.  All
+  // fields little-endian.
+  //   request:  ServeRequest, then length bytes of payload.  A binary
+  //             payload is interleaved x,y doubles, length/16 points; a
+  //             CSV payload is text in any format parseFile accepts
+  //   response: ServeResponse
+  enum ServeFormat {
+    SERVE_BINARY = 0,
+    SERVE_CSV = 1
+  };
+
+  enum ServeStatus {
+    SERVE_OK = 0,
+    SERVE_BAD_REQUEST = 1,   // unknown format or ragged binary payload
+    SERVE_TOO_FEW = 2,       // fewer than 2 points
+    SERVE_TOO_LARGE = 3      // payload over SERVE_MAX_PAYLOAD; connection closed
+  };
+
+  struct ServeRequest {
+    uint32_t format;    // ServeFormat
+    uint32_t reserved;
+    uint64_t length;    // payload bytes
+  };
+  static_assert(sizeof(ServeRequest) == 16, "serve request layout");
+
+  struct ServeResponse {
+    uint32_t status;    // ServeStatus
+    uint32_t reserved;
+    uint64_t count;     // # of points fitted
+    double m;
+    double b;
+    double xMean;       // x̄
+  };
+  static_assert(sizeof(ServeResponse) == 40, "serve response layout");
+
+  static const uint64_t SERVE_MAX_PAYLOAD = 1ULL << 30;
+  // A connection that sends nothing for this long is closed
+  static const int SERVE_IDLE_SECONDS = 30;
+
+  // Serve fits on a Unix domain socket path, or "tcp:host:port", until
+  // the process is killed.  Connections are handed to a pool of worker
+  // threads, 0 for one per hardware thread.  False if it could not listen
+  bool serve(const char *address, unsigned threads);
+
+} // namespace hedger
+
+#endif // REGRESSION_H
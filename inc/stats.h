@@ -0,0 +1,96 @@
+// stats.h
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+// Hot path instrumentation: per phase wall time and ingest counters.
+// The STATS_ macros compile to nothing unless REGRESSION_STATS is
+// defined (make STATS=1), so the default build pays nothing for them.
+//
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+
+namespace hedger {
+  enum StatsPhase {
+    STATS_OPEN,       // opening and mapping input
+    STATS_PARSE,      // tokenizing, including any fused summing
+    STATS_COPY,       // copying parsed values into their final layout
+    STATS_SUMS,       // summing and fitting stored points
+    STATS_OUTPUT,     // printing results
+    STATS_PHASES
+  };
+
+  // Stats
+  // Process wide totals.  Counters are added once per buffer or phase,
+  // never per token, so contention between parser threads is negligible.
+  struct Stats {
+    std::atomic<uint64_t> nanoseconds[STATS_PHASES];
+    std::atomic<uint64_t> bytes;        // input bytes read or mapped
+    std::atomic<uint64_t> tokens;       // numbers parsed
+    std::atomic<uint64_t> malformed;    // tokens that did not parse
+    std::atomic<uint64_t> points;       // points fitted
+  };
+  extern Stats stats;
+
+  // StatsTimer
+  // Scoped timer adding its lifetime to one phase
+  class StatsTimer {
+  public:
+    explicit StatsTimer(StatsPhase phase) :
+      phase_(phase), start_(std::chrono::steady_clock::now()) {}
+    ~StatsTimer() {
+      stats.nanoseconds[phase_] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start_).count();
+    }
+  private:
+    StatsTimer(const StatsTimer &);
+    StatsTimer &operator=(const StatsTimer &);
+
+    StatsPhase phase_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  // statsEnabled
+  // Exit: true if the library was built with REGRESSION_STATS
+  bool statsEnabled();
+
+  // printStats
+  // Print the totals collected so far
+  // Entry: destination stream
+  //        true for one line of JSON, false for text
+  //        total wall time in seconds, for points/sec
+  void printStats(FILE *f, bool json, double seconds);
+} // namespace hedger
+
+#ifdef REGRESSION_STATS
+#define STATS_CONCAT_(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_(a, b)
+#define STATS_TIMER(phase) hedger::StatsTimer STATS_CONCAT(statsTimer, __LINE__)(phase)
+#define STATS_ADD(counter, n) (hedger::stats.counter += (n))
+#else
+#define STATS_TIMER(phase) do {} while (0)
+#define STATS_ADD(counter, n) ((void) (n))
+#endif
+
+#endif // STATS_H
@@ -0,0 +1,72 @@
+// arena.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+
+#include <algorithm>
+
+#include "regression.h"
+
+namespace hedger {
+  Arena::~Arena()
+  {
+    for (size_t i = 0; i < blocks_.size(); i++) {
+      free(blocks_[i].data);
+    }
+  }
+
+  // allocate
+  // Carve from the current block, moving on to the next kept block or a
+  // new one when it runs out.  Kept blocks too small for the request are
+  // skipped until the next reset.
+  void *Arena::allocate(size_t bytes)
+  {
+    bytes = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    while (current_ < blocks_.size()) {
+      Block &block = blocks_[current_];
+      if (bytes <= block.size - used_) {
+        void *p = block.data + used_;
+        used_ += bytes;
+        return p;
+      }
+      current_++;
+      used_ = 0;
+    }
+
+    Block block;
+    block.size = std::max(blockSize_, bytes);
+    void *p = NULL;
+    if (posix_memalign(&p, ALIGNMENT, block.size)) {
+      return NULL;
+    }
+    block.data = static_cast<char *>(p);
+    blocks_.push_back(block);
+    current_ = blocks_.size() - 1;
+    used_ = bytes;
+    return block.data;
+  }
+
+  size_t Arena::reserved() const
+  {
+    size_t total = 0;
+    for (size_t i = 0; i < blocks_.size(); i++) {
+      total += blocks_[i].size;
+    }
+    return total;
+  }
+} // namespace hedger
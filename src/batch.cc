@@ -0,0 +1,267 @@
+// batch.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "regression.h"
+#include "scanner.h"
+
+using namespace std;
+
+namespace hedger {
+  // GroupTable
+  // Open addressing hash table from a series key to its running sums.
+  // Keys are not copied; they point into the input buffer, which outlives
+  // the table.
+  class GroupTable {
+  public:
+    struct Entry {
+      const char *key;    // NULL marks an empty slot
+      size_t length;
+      uint64_t hash;
+      Sums sums;
+    };
+
+    GroupTable() : entries_(16), size_(0) {}
+
+    // hash
+    // FNV-1a over the key bytes
+    static uint64_t hash(const char *key, size_t length)
+    {
+      uint64_t h = 14695981039346656037ULL;
+      for (size_t i = 0; i < length; i++) {
+        h ^= (unsigned char) key[i];
+        h *= 1099511628211ULL;
+      }
+      return h;
+    }
+
+    // partition
+    // Table for a key among partitions, from the high hash bits: find()
+    // probes from the low ones, which would otherwise be the same for
+    // every key of a partition and pile them into one run of slots
+    static size_t partition(uint64_t h, size_t partitions)
+    {
+      return (h >> 32) % partitions;
+    }
+
+    // find
+    // Get the sums for a key, inserting an empty entry if it is new.
+    Sums &find(const char *key, size_t length, uint64_t h)
+    {
+      if (2 * (size_ + 1) > entries_.size()) {
+        grow();
+      }
+      size_t mask = entries_.size() - 1;
+      for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        Entry &e = entries_[i];
+        if (!e.key) {
+          e.key = key;
+          e.length = length;
+          e.hash = h;
+          size_++;
+          return e.sums;
+        }
+        if (e.hash == h && e.length == length && !memcmp(e.key, key, length)) {
+          return e.sums;
+        }
+      }
+    }
+
+    const vector<Entry> &entries() const { return entries_; }
+
+  private:
+    void grow()
+    {
+      vector<Entry> old(entries_.size() * 2);
+      old.swap(entries_);
+      size_t mask = entries_.size() - 1;
+      for (size_t j = 0; j < old.size(); j++) {
+        if (!old[j].key) {
+          continue;
+        }
+        size_t i = old[j].hash & mask;
+        while (entries_[i].key) {
+          i = (i + 1) & mask;
+        }
+        entries_[i] = old[j];
+      }
+    }
+
+    vector<Entry> entries_;
+    size_t size_;
+  };
+
+  // PairSink
+  // Scanner sink that keeps the first two numbers of a line.
+  struct PairSink {
+    PairSink() : count(0) {}
+    void operator()(double d)
+    {
+      if (count < 2) {
+        v[count] = d;
+      }
+      count++;
+    }
+    double v[2];
+    int count;
+  };
+
+  inline bool isKeyEnd(char c)
+  {
+    return ',' == c || ';' == c || '\t' == c || ' ' == c || '|' == c;
+  }
+
+  // sumGroups
+  // Parse whole key,x,y lines from a byte range into per partition tables.
+  // The key is everything up to the first ',', ';', tab, space or '|';
+  // the first two numbers after it are x and y.  Lines with fewer are
+  // skipped.
+  // Entry: pointer to first character, at the start of a line
+  //        pointer one past the last character
+  //        one table per partition, chosen by GroupTable::partition
+  static void sumGroups(const char *p, const char *end, vector<GroupTable> *tables)
+  {
+    size_t partitions = tables->size();
+    while (p < end) {
+      const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+      if (!eol) {
+        eol = end;
+      }
+      const char *keyEnd = p;
+      while (keyEnd < eol && !isKeyEnd(*keyEnd) && '\r' != *keyEnd) {
+        keyEnd++;
+      }
+      if (keyEnd != p) {
+        PairSink pair;
+        scanBuffer(keyEnd, eol, true, pair);
+        if (pair.count >= 2) {
+          uint64_t h = GroupTable::hash(p, keyEnd - p);
+          (*tables)[GroupTable::partition(h, partitions)].find(p, keyEnd - p, h).add(pair.v[0], pair.v[1]);
+        }
+      }
+      p = eol + 1;
+    }
+  }
+
+  // fitGroups
+  // Fit every series in a file of key,x,y lines.  The input is cut into
+  // line aligned byte ranges; each thread sums its range into a table per
+  // key partition.  Then each thread takes one partition, merges that
+  // partition's tables from every range and fits its keys, so both the
+  // parse and the reduction run in parallel across groups.
+  // Entry: filename, or "-" for standard input
+  //        # of threads, 0 for one per hardware thread
+  //        pointer to destination fits, sorted by key
+  // Exit: true on success
+  bool fitGroups(const char *file, unsigned threads, vector<GroupFit> *fits)
+  {
+    const size_t MIN_CHUNK = 1 << 20;
+    InputFile in;
+    vector<char> buffer;
+    {
+      STATS_TIMER(STATS_OPEN);
+      if (!in.open(file)) {
+        return false;
+      }
+      if (!in.isMapped() && !in.readAll(&buffer)) {
+        return false;
+      }
+    }
+    STATS_TIMER(STATS_PARSE);
+    const char *begin = in.isMapped() ? in.data() : buffer.data();
+    size_t size = in.isMapped() ? in.size() : buffer.size();
+    const char *end = begin + size;
+    STATS_ADD(bytes, size);
+
+    if (!threads) {
+      threads = std::thread::hardware_concurrency();
+    }
+    threads = std::max(1u, std::min<unsigned>(threads, size / MIN_CHUNK + 1));
+
+    // Cut at even offsets, moving each cut to the start of the next line
+    vector<const char *> cuts(threads + 1);
+    cuts[0] = begin;
+    cuts[threads] = end;
+    for (unsigned i = 1; i < threads; i++) {
+      const char *p = std::max(cuts[i - 1], begin + size / threads * i);
+      const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+      cuts[i] = eol ? eol + 1 : end;
+    }
+
+    vector<vector<GroupTable> > tables(threads, vector<GroupTable>(threads));
+    vector<vector<GroupFit> > partials(threads);
+    vector<std::thread> workers;
+
+    // Parse: one byte range per thread
+    for (unsigned i = 0; i < threads; i++) {
+      workers.push_back(std::thread([&tables, &cuts, i]() {
+        sumGroups(cuts[i], cuts[i + 1], &tables[i]);
+      }));
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+      workers[i].join();
+    }
+    workers.clear();
+
+    // Reduce and fit: one key partition per thread
+    for (unsigned j = 0; j < threads; j++) {
+      workers.push_back(std::thread([&tables, &partials, threads, j]() {
+        GroupTable merged;
+        for (unsigned i = 0; i < threads; i++) {
+          const vector<GroupTable::Entry> &entries = tables[i][j].entries();
+          for (size_t k = 0; k < entries.size(); k++) {
+            const GroupTable::Entry &e = entries[k];
+            if (e.key) {
+              merged.find(e.key, e.length, e.hash).merge(e.sums);
+            }
+          }
+        }
+        const vector<GroupTable::Entry> &entries = merged.entries();
+        for (size_t k = 0; k < entries.size(); k++) {
+          const GroupTable::Entry &e = entries[k];
+          if (e.key) {
+            GroupFit g;
+            g.key.assign(e.key, e.length);
+            getFit(e.sums, &g.fit);
+            partials[j].push_back(g);
+          }
+        }
+      }));
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+      workers[i].join();
+    }
+
+    fits->clear();
+    for (unsigned j = 0; j < threads; j++) {
+      fits->insert(fits->end(), partials[j].begin(), partials[j].end());
+    }
+    std::sort(fits->begin(), fits->end(),
+        [](const GroupFit &a, const GroupFit &b) { return a.key < b.key; });
+    return true;
+  }
+
+} // namespace hedger
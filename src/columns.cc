@@ -0,0 +1,214 @@
+// columns.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+
+#include "regression.h"
+#include "stats.h"
+
+using namespace std;
+
+namespace hedger {
+  static bool isLittleEndian()
+  {
+    const uint16_t probe = 1;
+    return 1 == *reinterpret_cast<const unsigned char *>(&probe);
+  }
+
+  static size_t columnTypeSize(uint32_t type)
+  {
+    switch (type) {
+      case COLUMN_FLOAT64: return sizeof(double);
+      case COLUMN_FLOAT32: return sizeof(float);
+      default: return 0;
+    }
+  }
+
+  // open
+  // Map a column file and check its header against the file size.
+  // Entry: filename
+  // Exit: true if the file is a usable column file
+  bool ColumnFile::open(const char *file)
+  {
+    STATS_TIMER(STATS_OPEN);
+    close();
+    if (!isLittleEndian()) {
+      return false;
+    }
+    int fd = ::open(file, O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+        (size_t) st.st_size < sizeof(ColumnFileHeader)) {
+      ::close(fd);
+      return false;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (MAP_FAILED == p) {
+      return false;
+    }
+    map_ = p;
+    mapSize_ = st.st_size;
+    header_ = static_cast<const ColumnFileHeader *>(p);
+
+    size_t width = columnTypeSize(header_->type);
+    if (memcmp(header_->magic, COLUMN_FILE_MAGIC, sizeof(COLUMN_FILE_MAGIC)) ||
+        COLUMN_FILE_VERSION != header_->version || !width ||
+        header_->count > (mapSize_ - sizeof(ColumnFileHeader)) / (2 * width)) {
+      close();
+      return false;
+    }
+    madvise(map_, mapSize_, MADV_SEQUENTIAL);
+    STATS_ADD(bytes, mapSize_);
+    return true;
+  }
+
+  void ColumnFile::setAccess(bool sequential) const
+  {
+    if (map_) {
+      madvise(map_, mapSize_, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    }
+  }
+
+  void ColumnFile::close()
+  {
+    if (map_) {
+      munmap(map_, mapSize_);
+    }
+    map_ = NULL;
+    mapSize_ = 0;
+    header_ = NULL;
+  }
+
+  // column
+  // Entry: 0 for x, 1 for y
+  // Exit: start of that column
+  const void *ColumnFile::column(int index) const
+  {
+    const char *base = reinterpret_cast<const char *>(header_ + 1);
+    return base + index * header_->count * columnTypeSize(header_->type);
+  }
+
+  const double *ColumnFile::x64() const
+  {
+    return COLUMN_FLOAT64 == type() ? static_cast<const double *>(column(0)) : NULL;
+  }
+
+  const double *ColumnFile::y64() const
+  {
+    return COLUMN_FLOAT64 == type() ? static_cast<const double *>(column(1)) : NULL;
+  }
+
+  const float *ColumnFile::x32() const
+  {
+    return COLUMN_FLOAT32 == type() ? static_cast<const float *>(column(0)) : NULL;
+  }
+
+  const float *ColumnFile::y32() const
+  {
+    return COLUMN_FLOAT32 == type() ? static_cast<const float *>(column(1)) : NULL;
+  }
+
+  // getSums
+  // Run the columnar sums kernel directly over the mapped columns.
+  void ColumnFile::getSums(Sums *sums) const
+  {
+    if (COLUMN_FLOAT32 == type()) {
+      hedger::getSums(x32(), y32(), size(), sums);
+    } else {
+      hedger::getSums(x64(), y64(), size(), sums);
+    }
+  }
+
+  // isColumnFile
+  // Entry: filename
+  // Exit: true if the file begins with the column file magic
+  bool ColumnFile::isColumnFile(const char *file)
+  {
+    char magic[sizeof(COLUMN_FILE_MAGIC)];
+    FILE *f = fopen(file, "rb");
+    if (!f) {
+      return false;
+    }
+    bool match = 1 == fread(magic, sizeof(magic), 1, f) &&
+      !memcmp(magic, COLUMN_FILE_MAGIC, sizeof(magic));
+    fclose(f);
+    return match;
+  }
+
+  // writeColumn
+  // Write one column, narrowing to float through a bounce buffer if asked.
+  static bool writeColumn(FILE *f, const double *values, size_t size, ColumnType type)
+  {
+    if (COLUMN_FLOAT64 == type) {
+      return fwrite(values, sizeof(double), size, f) == size;
+    }
+    const size_t BLOCK = 1 << 16;
+    vector<float> narrow(BLOCK);
+    for (size_t i = 0; i < size; i += BLOCK) {
+      size_t n = std::min(BLOCK, size - i);
+      for (size_t j = 0; j < n; j++) {
+        narrow[j] = (float) values[i + j];
+      }
+      if (fwrite(&narrow[0], sizeof(float), n, f) != n) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // write
+  // Entry: destination filename
+  //        data set to store
+  //        column type to store it as
+  // Exit: true on success
+  bool ColumnFile::write(const char *file, const DataSet &data, ColumnType type)
+  {
+    if (!isLittleEndian() || !columnTypeSize(type)) {
+      return false;
+    }
+    ColumnFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COLUMN_FILE_MAGIC, sizeof(header.magic));
+    header.version = COLUMN_FILE_VERSION;
+    header.type = type;
+    header.count = data.size();
+
+    FILE *f = fopen(file, "wb");
+    if (!f) {
+      return false;
+    }
+    bool ok = 1 == fwrite(&header, sizeof(header), 1, f) &&
+      writeColumn(f, data.x(), data.size(), type) &&
+      writeColumn(f, data.y(), data.size(), type);
+    ok &= !fclose(f);
+    return ok;
+  }
+
+} // namespace hedger
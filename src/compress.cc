@@ -0,0 +1,226 @@
+// compress.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#ifdef REGRESSION_ZLIB
+#include <zlib.h>
+#endif
+#ifdef REGRESSION_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compress.h"
+
+namespace hedger {
+  Compression detectCompression(const char *head, size_t size)
+  {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(head);
+    if (size >= 2 && 0x1f == p[0] && 0x8b == p[1]) {
+      return COMPRESSION_GZIP;
+    }
+    if (size >= 4 && 0x28 == p[0] && 0xb5 == p[1] && 0x2f == p[2] && 0xfd == p[3]) {
+      return COMPRESSION_ZSTD;
+    }
+    return COMPRESSION_NONE;
+  }
+
+  // Compressed bytes per read
+  static const size_t COMPRESSED_BLOCK = 1 << 20;
+
+  // CompressedInput
+  // Compressed bytes for a decompressor: first the bytes read while
+  // detecting the format, then large reads from the descriptor.
+  class CompressedInput {
+  public:
+    CompressedInput(int fd, const char *head, size_t size) :
+      fd_(fd), buffer_(std::max(COMPRESSED_BLOCK, size)), pending_(size)
+    {
+      memcpy(buffer_.data(), head, size);
+    }
+
+    // fill
+    // Exit: # of bytes now at data(), 0 at end of file, -1 on error
+    ssize_t fill()
+    {
+      if (pending_) {
+        ssize_t n = pending_;
+        pending_ = 0;
+        return n;
+      }
+      ssize_t n;
+      do {
+        n = ::read(fd_, buffer_.data(), buffer_.size());
+      } while (n < 0 && EINTR == errno);
+      return n;
+    }
+    const char *data() const { return buffer_.data(); }
+
+  private:
+    int fd_;
+    std::vector<char> buffer_;
+    size_t pending_;    // head bytes not yet handed out
+  };
+
+#ifdef REGRESSION_ZLIB
+  // GzipDecompressor
+  // gzip or zlib stream; concatenated gzip members are read as one stream,
+  // and zero bytes padding out the last member are ignored, as gunzip
+  // does.
+  class GzipDecompressor : public Decompressor {
+  public:
+    GzipDecompressor(int fd, const char *head, size_t size) :
+      input_(fd, head, size), ended_(false)
+    {
+      memset(&z_, 0, sizeof(z_));
+      ok_ = Z_OK == inflateInit2(&z_, 15 + 32);   // +32 detects the header
+    }
+    ~GzipDecompressor()
+    {
+      if (ok_) {
+        inflateEnd(&z_);
+      }
+    }
+
+    ssize_t read(char *buffer, size_t size)
+    {
+      if (!ok_) {
+        return -1;
+      }
+      size = std::min(size, (size_t) UINT_MAX);
+      z_.next_out = reinterpret_cast<Bytef *>(buffer);
+      z_.avail_out = size;
+      while (z_.avail_out == size) {
+        if (0 == z_.avail_in) {
+          ssize_t n = input_.fill();
+          if (n <= 0) {
+            // A stream that stops inside a member is truncated
+            return n < 0 || !ended_ ? -1 : 0;
+          }
+          z_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input_.data()));
+          z_.avail_in = n;
+        }
+        if (ended_) {
+          // Padding (tape blocks, preallocated files) after the member
+          // just finished, or another member
+          while (z_.avail_in && 0 == *z_.next_in) {
+            z_.next_in++;
+            z_.avail_in--;
+          }
+          if (0 == z_.avail_in) {
+            continue;
+          }
+          if (Z_OK != inflateReset(&z_)) {
+            return -1;
+          }
+          ended_ = false;
+        }
+        int result = inflate(&z_, Z_NO_FLUSH);
+        if (Z_STREAM_END == result) {
+          ended_ = true;
+        } else if (Z_OK != result && Z_BUF_ERROR != result) {
+          return -1;
+        }
+      }
+      return size - z_.avail_out;
+    }
+
+  private:
+    CompressedInput input_;
+    z_stream z_;
+    bool ok_;
+    bool ended_;    // the last member finished
+  };
+#endif // REGRESSION_ZLIB
+
+#ifdef REGRESSION_ZSTD
+  // ZstdDecompressor
+  // zstd stream of one or more frames.
+  class ZstdDecompressor : public Decompressor {
+  public:
+    ZstdDecompressor(int fd, const char *head, size_t size) :
+      input_(fd, head, size), stream_(ZSTD_createDStream()), hint_(1)
+    {
+      if (stream_ && ZSTD_isError(ZSTD_initDStream(stream_))) {
+        ZSTD_freeDStream(stream_);
+        stream_ = NULL;
+      }
+      in_.src = NULL;
+      in_.size = in_.pos = 0;
+    }
+    ~ZstdDecompressor()
+    {
+      ZSTD_freeDStream(stream_);
+    }
+
+    ssize_t read(char *buffer, size_t size)
+    {
+      if (!stream_) {
+        return -1;
+      }
+      ZSTD_outBuffer out = { buffer, size, 0 };
+      while (0 == out.pos) {
+        if (in_.pos == in_.size) {
+          ssize_t n = input_.fill();
+          if (n <= 0) {
+            // The hint is 0 only once a frame is complete
+            return n < 0 || hint_ ? -1 : 0;
+          }
+          in_.src = input_.data();
+          in_.size = n;
+          in_.pos = 0;
+        }
+        hint_ = ZSTD_decompressStream(stream_, &out, &in_);
+        if (ZSTD_isError(hint_)) {
+          return -1;
+        }
+      }
+      return out.pos;
+    }
+
+  private:
+    CompressedInput input_;
+    ZSTD_DStream *stream_;
+    ZSTD_inBuffer in_;
+    size_t hint_;   // from the last ZSTD_decompressStream
+  };
+#endif // REGRESSION_ZSTD
+
+  Decompressor *Decompressor::create(Compression format, int fd, const char *head, size_t size)
+  {
+    switch (format) {
+#ifdef REGRESSION_ZLIB
+    case COMPRESSION_GZIP:
+      return new GzipDecompressor(fd, head, size);
+#endif
+#ifdef REGRESSION_ZSTD
+    case COMPRESSION_ZSTD:
+      return new ZstdDecompressor(fd, head, size);
+#endif
+    default:
+      return NULL;
+    }
+  }
+} // namespace hedger
@@ -0,0 +1,69 @@
+// compress.h
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+// Internal streaming decompression of gzip (REGRESSION_ZLIB) and zstd
+// (REGRESSION_ZSTD) input.
+//
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+namespace hedger {
+  enum Compression {
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD
+  };
+
+  // Bytes needed to recognise every supported format
+  static const size_t COMPRESSION_MAGIC = 4;
+
+  // detectCompression
+  // Entry: first bytes of the input
+  //        # of bytes, fewer than COMPRESSION_MAGIC only for tiny inputs
+  // Exit: format the bytes start with, whether or not it was built in
+  Compression detectCompression(const char *head, size_t size);
+
+  // Decompressor
+  // Pulls compressed bytes from a file descriptor and hands out the
+  // decompressed stream.
+  class Decompressor {
+  public:
+    virtual ~Decompressor() {}
+
+    // read
+    // Entry: destination buffer
+    //        capacity of buffer
+    // Exit: bytes decompressed, 0 at the end of the stream, -1 on error
+    virtual ssize_t read(char *buffer, size_t size) = 0;
+
+    // create
+    // Entry: format of the stream
+    //        descriptor to read compressed bytes from; not owned
+    //        compressed bytes already read from it
+    //        # of those bytes
+    // Exit: new decompressor, or NULL if the format was not built in
+    static Decompressor *create(Compression format, int fd, const char *head, size_t size);
+  };
+} // namespace hedger
+
+#endif // COMPRESS_H
@@ -0,0 +1,609 @@
+// main.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "regression.h"
+#include "stats.h"
+
+using namespace std;
+
+// Writer for the -o formats; NULL for the human readable text
+static hedger::OutputWriter *output = NULL;
+
+// Fields from -cols, -skip and -delim; NULL to pair up every number
+static hedger::Fields *fields = NULL;
+
+// printUsage
+// Print command line help
+static void printUsage() {
+  printf("regression\n");
+  printf("Ordinary Least Squares (OLS) linear regression analysis.\n");
+  printf("Calculates Y baseline b and slope m from set of {x,y} points.\n");
+  printf("Copyright (C) 2020 Greg Hedger\n");
+  printf("\nOptions:\n");
+  printf("  -f Specify CSV or other non-digit-separated file\n");
+  printf("  -xf Specify file and swap x and y values\n");
+  printf("  -s Stream file (or stdin) in one pass without storing points\n");
+  printf("  -xs Stream and swap x and y values\n");
+  printf("  -p Parse and sum file in parallel, optionally with thread count\n");
+  printf("  -xp Parse in parallel and swap x and y values\n");
+  printf("  -w Fit a sliding window of the last K points, one line per step\n");
+  printf("  -g Fit every series of a key,x,y file, one line per key\n");
+  printf("  -b Fit a binary column file without parsing\n");
+  printf("  -convert Convert a CSV file to a binary column file (f32 for float)\n");
+  printf("  -m Fit P predictors per line (x₁ … x_P y), optionally with thread count\n");
+  printf("  -poly Fit a degree K polynomial in one streaming pass\n");
+  printf("  -wls Weighted least squares over x,y,w triples\n");
+  printf("  -det Compensated sums, identical for any thread count\n");
+  printf("  -robust Theil–Sen fit, the median of pairwise slopes, resistant to outliers\n");
+  printf("  -sample Fit K sampled points with 95%% intervals; a binary column file is\n");
+  printf("          read only at the sampled rows, refined to a relative m error\n");
+  printf("  -serve Serve fits on a Unix socket or tcp:host:port, optionally with thread count\n");
+  printf("  -stats Before any mode, print timings and counters to stderr\n");
+  printf("  -o Before any mode, write results as json lines, csv or binary records\n");
+  printf("  -cols Before a two column mode, read x and y from fields X,Y (from 1)\n");
+  printf("  -skip Before a two column mode, skip N header lines\n");
+  printf("  -delim Field delimiter for -cols and -skip, default ',' (tab for a tab)\n");
+  printf("\nUsage:\n");
+  printf(" regression [x₁] [y₁] ... [xₙ] [yₙ]\n");
+  printf(" regression -f [csv_file]\n");
+  printf(" regression -xf [csv_file]\n");
+  printf(" regression -s [csv_file|-]\n");
+  printf(" regression -p [csv_file] [threads]\n");
+  printf(" regression -w [K] [csv_file|-]\n");
+  printf(" regression -g [csv_file|-] [threads]\n");
+  printf(" regression -b [bin_file]\n");
+  printf(" regression -convert [csv_file] [bin_file] [f32]\n");
+  printf(" regression -m [P] [csv_file|-] [threads]\n");
+  printf(" regression -poly [K] [csv_file|-]\n");
+  printf(" regression -wls [csv_file|-]\n");
+  printf(" regression -det [csv_file|-] [threads]\n");
+  printf(" regression -robust [csv_file|-]\n");
+  printf(" regression -sample [K] [csv_file|-]\n");
+  printf(" regression -sample [K] [bin_file] [target]\n");
+  printf(" regression -serve [socket_path|tcp:host:port] [threads]\n");
+  printf(" regression -stats[=json] [mode] ...\n");
+  printf(" regression -o [json|csv|bin] [mode] ...\n");
+  printf(" regression -cols [X,Y] -skip [N] -delim [C] [-f|-s|-p|-w|-det|-robust|-convert] ...\n");
+  printf("CSV files can use any non-digit separator, and may be gzip or\n");
+  printf("zstd compressed if the build supports it.");
+}
+
+// printBestFit
+// Print the fit, y at the center point x̄ and how well the line fits
+// Entry: fit
+//        method named in the heading
+static void printBestFit(const hedger::Fit &fit, const char *method = "OLS")
+{
+  STATS_TIMER(hedger::STATS_OUTPUT);
+  STATS_ADD(points, fit.sums.n);
+  if (output) {
+    output->writeFit(fit);
+    return;
+  }
+  printf("Best fit (%s):\n", method);
+  printf("b=%lf\nm=%lf\n", fit.b, fit.m);
+
+  // Print y at center point x-bar
+  printf("\ny=%lf at x=x̄=%lf\n", fit.yAtMean, fit.xMean);
+
+  // Goodness of fit: R², residual variance s² and standard errors
+  printf("\nR²=%lf\ns²=%lf\nσb=%lf\nσm=%lf\n",
+      fit.r2, fit.residualVariance, fit.baselineError, fit.slopeError);
+}
+
+// printWindowStep
+// Point callback for windowed mode; prints the fit once the window is full
+static void printWindowStep(double x, double y, void *context)
+{
+  hedger::WindowFit *window = static_cast<hedger::WindowFit *>(context);
+  window->add(x, y);
+  STATS_ADD(points, 1);
+  if (window->full()) {
+    double m = 0.0, b = 0.0;
+    window->getBestFit(&b, &m);
+    if (output) {
+      output->writeWindowStep(x, b, m);
+    } else {
+      printf("x=%lf b=%lf m=%lf\n", x, b, m);
+    }
+  }
+}
+
+// printSampledFit
+// Print a sampled fit and its confidence intervals
+static void printSampledFit(const hedger::SampledFit &fit)
+{
+  if (output) {
+    STATS_ADD(points, fit.fit.sums.n);
+    output->writeSample(fit);
+    return;
+  }
+  char method[64];
+  snprintf(method, sizeof(method), "sample of %zu/%zu", fit.fit.sums.n, fit.rows);
+  printBestFit(fit.fit, method);
+  printf("\n95%% intervals:\nb=%lf ± %lf\nm=%lf ± %lf\n",
+      fit.fit.b, fit.bInterval, fit.fit.m, fit.mInterval);
+}
+
+static const int DATA_SIZE = 6;
+
+// parseInput
+// parseFile through any field selection
+static bool parseInput(const char *file, hedger::DataSet *data)
+{
+  return fields ? hedger::parseFile(file, *fields, data) : hedger::parseFile(file, data);
+}
+
+// supportsFields
+// Modes that read two columns of text, where -cols and -skip apply
+static bool supportsFields(const char *mode)
+{
+  static const char *MODES[] = {
+    "-f", "-xf", "-s", "-xs", "-p", "-xp", "-w", "-det", "-robust", "-convert"
+  };
+  for (size_t i = 0; i < sizeof(MODES) / sizeof(MODES[0]); i++) {
+    if (!strcmp(mode, MODES[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// run
+// Dispatch on the mode argument
+// Entry: arguments with the leading options removed
+// Exit: process exit status
+static int run(int argc, const char *argv[])
+{
+  using namespace hedger;
+  DataSet data;
+  bool fromFile = false;
+
+  if (fields && (argc < 2 || !supportsFields(argv[1]))) {
+    printf("-cols, -skip and -delim need a two column file mode\n");
+    return 1;
+  }
+
+  // Streaming and parallel modes: one pass, nothing stored
+  bool stream = argc >= 2 && argc <= 3 &&
+    (!strcmp(argv[1], "-s") || !strcmp(argv[1], "-xs"));
+  bool parallel = argc >= 3 && argc <= 4 &&
+    (!strcmp(argv[1], "-p") || !strcmp(argv[1], "-xp"));
+  if (stream || parallel) {
+    const char *file = argc > 2 ? argv[2] : "-";
+    bool swap = 'x' == argv[1][1];
+    Sums sums;
+    bool ok;
+    if (fields) {
+      // Whole lines on one thread
+      Fields selected = *fields;
+      if (swap) {
+        std::swap(selected.x, selected.y);
+      }
+      ok = streamFile(file, selected, &sums);
+    } else if (parallel) {
+      ok = sumFileParallel(file, swap, argc > 3 ? atoi(argv[3]) : 0, &sums);
+    } else {
+      ok = streamFile(file, swap, &sums);
+    }
+    if (!ok) {
+      printf("Could not read data, file '%s'\n", file);
+      return -1;
+    }
+    Fit fit;
+    getFit(sums, &fit);
+    printBestFit(fit);
+    return 0;
+  }
+
+  // Windowed mode: rolling fit over the last K points
+  if (argc >= 3 && argc <= 4 && !strcmp(argv[1], "-w")) {
+    long window = atol(argv[2]);
+    const char *file = argc > 3 ? argv[3] : "-";
+    if (window < 2) {
+      printf("Window must hold at least 2 points\n");
+      return -1;
+    }
+    WindowFit fit(window);
+    bool ok = fields ? streamPoints(file, *fields, printWindowStep, &fit) :
+      streamPoints(file, false, printWindowStep, &fit);
+    if (!ok) {
+      printf("Could not read data, file '%s'\n", file);
+      return -1;
+    }
+    if (!fit.full()) {
+      printf("WARNING: Fewer than %ld points, no window fitted\n", window);
+    }
+    return 0;
+  }
+
+  // Binary column file: map and sum, nothing to parse
+  if (3 == argc && !strcmp(argv[1], "-b")) {
+    ColumnFile columns;
+    if (!columns.open(argv[2])) {
+      printf("Could not read column file '%s'\n", argv[2]);
+      return -1;
+    }
+    Sums sums;
+    Fit fit;
+    {
+      STATS_TIMER(STATS_SUMS);
+      columns.getSums(&sums);
+      getFit(sums, &fit);
+    }
+    printBestFit(fit);
+    return 0;
+  }
+
+  // Convert CSV to a binary column file
+  if (argc >= 4 && argc <= 5 && !strcmp(argv[1], "-convert")) {
+    ColumnType type = COLUMN_FLOAT64;
+    if (argc > 4) {
+      if (strcmp(argv[4], "f32")) {
+        printUsage();
+        return 1;
+      }
+      type = COLUMN_FLOAT32;
+    }
+    if (!parseInput(argv[2], &data)) {
+      printf("Could not read or allocate data, file '%s'\n", argv[2]);
+      return -1;
+    }
+    if (!ColumnFile::write(argv[3], data, type)) {
+      printf("Could not write column file '%s'\n", argv[3]);
+      return -1;
+    }
+    return 0;
+  }
+
+  // Reproducible mode: compensated sums, the same bits for any threads
+  if (argc >= 2 && argc <= 4 && !strcmp(argv[1], "-det")) {
+    const char *file = argc > 2 ? argv[2] : "-";
+    if (!parseInput(file, &data)) {
+      printf("Could not read or allocate data, file '%s'\n", file);
+      return -1;
+    }
+    Sums sums;
+    getSumsReproducible(data, argc > 3 ? atoi(argv[3]) : 0, &sums);
+    Fit fit;
+    getFit(sums, &fit);
+    printBestFit(fit);
+    return 0;
+  }
+
+  // Robust mode: Theil–Sen over a parsed file
+  if (argc >= 2 && argc <= 3 && !strcmp(argv[1], "-robust")) {
+    const char *file = argc > 2 ? argv[2] : "-";
+    if (!parseInput(file, &data)) {
+      printf("Could not read or allocate data, file '%s'\n", file);
+      return -1;
+    }
+    double b, m;
+    if (!getTheilSen(data, &b, &m)) {
+      printf("Could not fit, fewer than two distinct x\n");
+      return -1;
+    }
+    double xMean = getMean(data);
+    if (output) {
+      // No closed form statistics for the median slope
+      Fit fit;
+      fit.sums.n = data.size();
+      fit.b = b;
+      fit.m = m;
+      fit.xMean = xMean;
+      fit.yAtMean = m * xMean + b;
+      fit.r2 = fit.residualVariance = fit.slopeError = fit.baselineError = NAN;
+      printBestFit(fit);
+      return 0;
+    }
+    STATS_TIMER(STATS_OUTPUT);
+    printf("Best fit (Theil–Sen):\n");
+    printf("b=%lf\nm=%lf\n", b, m);
+    printf("\ny=%lf at x=x̄=%lf\n", m * xMean + b, xMean);
+    return 0;
+  }
+
+  // Sampled mode: approximate fit with confidence intervals
+  if (argc >= 3 && argc <= 5 && !strcmp(argv[1], "-sample")) {
+    long size = atol(argv[2]);
+    const char *file = argc > 3 ? argv[3] : "-";
+    if (size < 3) {
+      printf("Sample must hold at least 3 points\n");
+      return -1;
+    }
+    SampledFit fit;
+    if (strcmp(file, "-") && ColumnFile::isColumnFile(file)) {
+      ColumnFile columns;
+      if (!columns.open(file)) {
+        printf("Could not read column file '%s'\n", file);
+        return -1;
+      }
+      sampleColumns(columns, size, argc > 4 ? atof(argv[4]) : 0.0, &fit);
+    } else {
+      if (argc > 4) {
+        printf("A target error needs a binary column file\n");
+        return 1;
+      }
+      if (!sampleFile(file, size, &fit)) {
+        printf("Could not read data, file '%s'\n", file);
+        return -1;
+      }
+    }
+    printSampledFit(fit);
+    return 0;
+  }
+
+  // Multiple regression: P predictors and y per line
+  if (argc >= 3 && argc <= 5 && !strcmp(argv[1], "-m")) {
+    long predictors = atol(argv[2]);
+    const char *file = argc > 3 ? argv[3] : "-";
+    if (predictors < 1) {
+      printf("Need at least 1 predictor\n");
+      return -1;
+    }
+    MultipleFit fit;
+    if (!fitMultiple(file, predictors, argc > 4 ? atoi(argv[4]) : 0, &fit)) {
+      printf("Could not read or fit data, file '%s'\n", file);
+      return -1;
+    }
+    STATS_TIMER(STATS_OUTPUT);
+    if (output) {
+      output->writeCoefficients(fit.n, fit.beta);
+      return 0;
+    }
+    printf("Best fit (OLS), p=%ld n=%zu:\n", predictors, fit.n);
+    printf("b=%lf\n", fit.beta[0]);
+    for (long i = 1; i <= predictors; i++) {
+      printf("m%ld=%lf\n", i, fit.beta[i]);
+    }
+    return 0;
+  }
+
+  // Polynomial: one pass of power sums, then a (K + 1)² solve
+  if (argc >= 3 && argc <= 4 && !strcmp(argv[1], "-poly")) {
+    long degree = atol(argv[2]);
+    const char *file = argc > 3 ? argv[3] : "-";
+    if (degree < 1) {
+      printf("Degree must be at least 1\n");
+      return -1;
+    }
+    PowerSums sums(degree);
+    if (!streamPowerSums(file, &sums)) {
+      printf("Could not read data, file '%s'\n", file);
+      return -1;
+    }
+    vector<double> c;
+    if (!fitPolynomial(sums, &c)) {
+      printf("Could not fit degree %ld, too few distinct x\n", degree);
+      return -1;
+    }
+    STATS_ADD(points, sums.size());
+    STATS_TIMER(STATS_OUTPUT);
+    if (output) {
+      output->writeCoefficients(sums.size(), c);
+      return 0;
+    }
+    printf("Best fit (polynomial), K=%ld n=%zu:\n", degree, sums.size());
+    for (long k = 0; k <= degree; k++) {
+      printf("c%ld=%lf\n", k, c[k]);
+    }
+    return 0;
+  }
+
+  // Weighted mode: x,y,w triples
+  if (argc >= 2 && argc <= 3 && !strcmp(argv[1], "-wls")) {
+    const char *file = argc > 2 ? argv[2] : "-";
+    WeightedSums sums;
+    if (!streamWeightedFile(file, &sums)) {
+      printf("Could not read data, file '%s'\n", file);
+      return -1;
+    }
+    Fit fit;
+    {
+      STATS_TIMER(STATS_SUMS);
+      getFit(sums, &fit);
+    }
+    printBestFit(fit, "WLS");
+    return 0;
+  }
+
+  // Server mode: answer framed fit requests until killed
+  if (argc >= 3 && argc <= 4 && !strcmp(argv[1], "-serve")) {
+    if (!serve(argv[2], argc > 3 ? atoi(argv[3]) : 0)) {
+      printf("Could not serve on '%s'\n", argv[2]);
+      return -1;
+    }
+    return 0;
+  }
+
+  // Grouped mode: one fit per key
+  if (argc >= 2 && argc <= 4 && !strcmp(argv[1], "-g")) {
+    const char *file = argc > 2 ? argv[2] : "-";
+    vector<GroupFit> fits;
+    if (!fitGroups(file, argc > 3 ? atoi(argv[3]) : 0, &fits)) {
+      printf("Could not read data, file '%s'\n", file);
+      return -1;
+    }
+    STATS_TIMER(STATS_OUTPUT);
+    for (size_t i = 0; i < fits.size(); i++) {
+      const Fit &fit = fits[i].fit;
+      STATS_ADD(points, fit.sums.n);
+      if (output) {
+        output->writeGroup(fits[i].key, fit.sums.n, fit.b, fit.m);
+      } else {
+        printf("%s n=%zu b=%lf m=%lf\n", fits[i].key.c_str(), fit.sums.n, fit.b, fit.m);
+      }
+    }
+    return 0;
+  }
+
+  if (argc < 5) {
+    if (argc > 2) {
+      if (!strcmp(argv[1], "-f") || !strcmp(argv[1], "-xf")) {
+        if (!parseInput(argv[2], &data)) {
+          printf("Could not read or allocate data, file '%s'\n", argv[2]);
+          return -1;
+        }
+        if (!strcmp(argv[1], "-xf")) {
+          data.swapAxes();
+        }
+        fromFile = true;
+      }
+    } else {
+      printUsage();
+      return 1;
+    }
+  }
+
+  // Pull in arguments from command line, if and only if we are not
+  // parsing from a file.
+  if (!fromFile) {
+    int data_size = (argc - 1) / 2;
+    if (!data.reserve(data_size)) {
+      printf("Could not allocate data\n");
+      return -1;
+    }
+    double x, y;
+    for (int i = 0; i < data_size; i++) {
+      sscanf(argv[ 1 + i * 2 ], "%lf", &x);
+      sscanf(argv[ 1 + i * 2 + 1 ], "%lf", &y);
+      data.add(x, y);
+    }
+
+    // Warn if odd # of arguments
+    if (data_size * 2 < (argc - 1)) {
+      printf("\nWARNING: Ignoring last param!");
+    }
+  }
+
+  // Get the Y baseline ("b"), slope ("m") and x̄ in one pass
+  Fit fit;
+  {
+    STATS_TIMER(STATS_SUMS);
+    getFit( data, &fit );
+  }
+  printBestFit(fit);
+
+  return 0;
+}
+
+// parseFieldOption
+// Entry: -cols, -skip or -delim
+//        its value: X,Y counting from 1, a line count, or one character
+//        or "tab"
+//        destination fields
+// Exit: true if the value is valid
+static bool parseFieldOption(const char *option, const char *value, hedger::Fields *fields)
+{
+  char *end;
+  if (!strcmp(option, "-cols")) {
+    long x = strtol(value, &end, 10);
+    if (',' != *end) {
+      return false;
+    }
+    long y = strtol(end + 1, &end, 10);
+    if (*end || x < 1 || y < 1) {
+      return false;
+    }
+    fields->x = x - 1;
+    fields->y = y - 1;
+  } else if (!strcmp(option, "-skip")) {
+    long header = strtol(value, &end, 10);
+    if (*end || header < 0) {
+      return false;
+    }
+    fields->header = header;
+  } else if (!strcmp(value, "tab")) {
+    fields->delimiter = '\t';
+  } else if (1 == strlen(value) && '\n' != *value) {
+    fields->delimiter = *value;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, const char *argv[])
+{
+  using namespace hedger;
+
+  // -stats[=json], -o and the field options ahead of the mode; shift them
+  // out of the way
+  bool stats = false, json = false;
+  OutputFormat format = OUTPUT_TEXT;
+  Fields selection;
+  for (;;) {
+    if (argc > 1 && (!strcmp(argv[1], "-stats") || !strcmp(argv[1], "-stats=json"))) {
+      stats = true;
+      json = !strcmp(argv[1], "-stats=json");
+      argv[1] = argv[0];
+      argv++;
+      argc--;
+      if (!statsEnabled()) {
+        fprintf(stderr, "WARNING: built without statistics, rebuild with make STATS=1\n");
+      }
+    } else if (argc > 2 && !strcmp(argv[1], "-o")) {
+      if (!parseOutputFormat(argv[2], &format)) {
+        printUsage();
+        return 1;
+      }
+      argv[2] = argv[0];
+      argv += 2;
+      argc -= 2;
+    } else if (argc > 2 && (!strcmp(argv[1], "-cols") || !strcmp(argv[1], "-skip") ||
+        !strcmp(argv[1], "-delim"))) {
+      if (!parseFieldOption(argv[1], argv[2], &selection)) {
+        printUsage();
+        return 1;
+      }
+      fields = &selection;
+      argv[2] = argv[0];
+      argv += 2;
+      argc -= 2;
+    } else {
+      break;
+    }
+  }
+
+  OutputWriter writer(STDOUT_FILENO, format);
+  if (OUTPUT_TEXT != format) {
+    output = &writer;
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  int status = run(argc, argv);
+  fflush(stdout);
+  if (output && !writer.flush()) {
+    fprintf(stderr, "Could not write output\n");
+    status = -1;
+  }
+  if (stats && statsEnabled()) {
+    printStats(stderr, json, std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count());
+  }
+  return status;
+}
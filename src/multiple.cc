@@ -0,0 +1,325 @@
+// multiple.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+// Multiple linear regression through the normal equations.
+//
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "regression.h"
+#include "scanner.h"
+#include "stats.h"
+
+using namespace std;
+
+namespace hedger {
+  NormalEquations::NormalEquations(size_t predictors) :
+    p_(predictors), n_(0), shift_(predictors), shifted_(false),
+    gram_((predictors + 2) * (predictors + 2)),
+    block_(BLOCK_ROWS * (predictors + 2)), pending_(0) {}
+
+  void NormalEquations::setShift(const double *shift)
+  {
+    if (!n_ && !pending_) {
+      std::copy(shift, shift + p_, shift_.begin());
+      shifted_ = true;
+    }
+  }
+
+  void NormalEquations::add(const double *x, double y)
+  {
+    if (!shifted_) {
+      setShift(x);
+    }
+    size_t d = p_ + 2;
+    double *z = &block_[pending_ * d];
+    z[0] = 1.0;
+    for (size_t j = 0; j < p_; j++) {
+      z[j + 1] = x[j] - shift_[j];
+    }
+    z[d - 1] = y;
+    if (BLOCK_ROWS == ++pending_) {
+      flush();
+    }
+  }
+
+  // flush
+  // Rank-k update G += ZᵀZ with the buffered rows Z.  Row i of G stays
+  // in cache across the block while each row of Z streams past it, and
+  // the innermost loop is an axpy along contiguous memory with no
+  // reduction, which the compiler vectorizes as written.
+  void NormalEquations::flush() const
+  {
+    size_t d = p_ + 2;
+    for (size_t i = 0; i < d; i++) {
+      double *g = &gram_[i * d];
+      for (size_t k = 0; k < pending_; k++) {
+        const double *z = &block_[k * d];
+        double zi = z[i];
+        for (size_t j = i; j < d; j++) {
+          g[j] += zi * z[j];
+        }
+      }
+    }
+    n_ += pending_;
+    pending_ = 0;
+  }
+
+  // merge
+  // Rows taken about another shift have z' = z + δ z₀, δⱼ the difference
+  // of the shifts, so their Gram matrix moves to this shift as
+  // G'ᵢⱼ = Gᵢⱼ + δᵢ G₀ⱼ + δⱼ Gᵢ₀ + δᵢ δⱼ G₀₀.
+  void NormalEquations::merge(const NormalEquations &other)
+  {
+    flush();
+    other.flush();
+    if (!other.n_) {
+      return;
+    }
+    if (!n_) {
+      shift_ = other.shift_;
+      shifted_ = true;
+    }
+    size_t d = p_ + 2;
+    vector<double> delta(d, 0.0);
+    for (size_t j = 0; j < p_; j++) {
+      delta[j + 1] = other.shift_[j] - shift_[j];
+    }
+    const vector<double> &g = other.gram_;
+    for (size_t i = 0; i < d; i++) {
+      for (size_t j = i; j < d; j++) {
+        gram_[i * d + j] += g[i * d + j] + delta[i] * g[j] + delta[j] * g[i] +
+          delta[i] * delta[j] * g[0];
+      }
+    }
+    n_ += other.n_;
+  }
+
+  void NormalEquations::clear()
+  {
+    std::fill(gram_.begin(), gram_.end(), 0.0);
+    std::fill(shift_.begin(), shift_.end(), 0.0);
+    shifted_ = false;
+    n_ = 0;
+    pending_ = 0;
+  }
+
+  // solve
+  // Factor the (p + 1)² XᵀX block as L Lᵀ from its upper triangle, then
+  // forward and back substitute with the Xᵀy column.  A pivot that has
+  // lost all but the last few digits of its diagonal means a predictor
+  // is, to rounding, a combination of the others.
+  bool NormalEquations::solve(vector<double> *beta) const
+  {
+    const double PIVOT_TOLERANCE = 1e-10;
+    flush();
+    size_t d = p_ + 2, q = p_ + 1;
+    vector<double> l(q * q);
+    for (size_t j = 0; j < q; j++) {
+      double diagonal = gram_[j * d + j];
+      for (size_t k = 0; k < j; k++) {
+        diagonal -= l[j * q + k] * l[j * q + k];
+      }
+      if (!(diagonal > gram_[j * d + j] * PIVOT_TOLERANCE)) {
+        return false;
+      }
+      l[j * q + j] = sqrt(diagonal);
+      for (size_t i = j + 1; i < q; i++) {
+        double v = gram_[j * d + i];
+        for (size_t k = 0; k < j; k++) {
+          v -= l[i * q + k] * l[j * q + k];
+        }
+        l[i * q + j] = v / l[j * q + j];
+      }
+    }
+
+    // L w = Xᵀy, then Lᵀ β = w
+    vector<double> w(q);
+    for (size_t i = 0; i < q; i++) {
+      double v = gram_[i * d + d - 1];
+      for (size_t k = 0; k < i; k++) {
+        v -= l[i * q + k] * w[k];
+      }
+      w[i] = v / l[i * q + i];
+    }
+    beta->resize(q);
+    for (size_t i = q; i-- > 0;) {
+      double v = w[i];
+      for (size_t k = i + 1; k < q; k++) {
+        v -= l[k * q + i] * (*beta)[k];
+      }
+      (*beta)[i] = v / l[i * q + i];
+    }
+    // β₀ + Σ βⱼ (xⱼ - shiftⱼ) = (β₀ - Σ βⱼ shiftⱼ) + Σ βⱼ xⱼ
+    for (size_t j = 0; j < p_; j++) {
+      (*beta)[0] -= (*beta)[j + 1] * shift_[j];
+    }
+    return true;
+  }
+
+  // solveFit
+  // Merge per thread equations and solve them into a fit.
+  static bool solveFit(vector<NormalEquations> *parts, MultipleFit *fit)
+  {
+    for (size_t i = 1; i < parts->size(); i++) {
+      (*parts)[0].merge((*parts)[i]);
+    }
+    fit->n = (*parts)[0].size();
+    STATS_ADD(points, fit->n);
+    STATS_TIMER(STATS_SUMS);
+    return (*parts)[0].solve(&fit->beta);
+  }
+
+  bool fitMultiple(const double *rows, size_t count, size_t predictors,
+      unsigned threads, MultipleFit *fit)
+  {
+    const size_t MIN_ROWS = 1 << 14;
+    if (!predictors) {
+      return false;
+    }
+    if (!threads) {
+      threads = std::thread::hardware_concurrency();
+    }
+    threads = std::max(1u, std::min<unsigned>(threads, count / MIN_ROWS + 1));
+
+    size_t width = predictors + 1;
+    vector<NormalEquations> parts(threads, NormalEquations(predictors));
+    vector<std::thread> workers;
+    auto sumRange = [rows, count, width, threads, predictors, &parts](unsigned i) {
+      size_t begin = count / threads * i;
+      size_t end = i + 1 == threads ? count : count / threads * (i + 1);
+      NormalEquations local(predictors);   // off the shared vector's cache lines
+      for (size_t r = begin; r < end; r++) {
+        local.add(rows + r * width, rows[r * width + width - 1]);
+      }
+      parts[i].merge(local);
+    };
+    {
+      STATS_TIMER(STATS_SUMS);
+      for (unsigned i = 1; i < threads; i++) {
+        workers.push_back(std::thread(sumRange, i));
+      }
+      sumRange(0);
+      for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+      }
+    }
+    return solveFit(&parts, fit);
+  }
+
+  // RowSink
+  // Scanner sink that keeps the first p + 1 numbers of a line.
+  struct RowSink {
+    RowSink(double *values, size_t width) : values(values), width(width), count(0) {}
+    void operator()(double d)
+    {
+      if (count < width) {
+        values[count] = d;
+      }
+      count++;
+    }
+    double *values;
+    size_t width;
+    size_t count;
+  };
+
+  // sumRows
+  // Parse whole lines of a byte range into normal equations.
+  // Entry: pointer to first character, at the start of a line
+  //        pointer one past the last character
+  //        destination equations
+  static void sumRows(const char *p, const char *end, NormalEquations *equations)
+  {
+    size_t width = equations->predictors() + 1;
+    vector<double> row(width);
+    while (p < end) {
+      const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+      if (!eol) {
+        eol = end;
+      }
+      RowSink sink(&row[0], width);
+      scanBuffer(p, eol, true, sink);
+      if (sink.count >= width) {
+        equations->add(&row[0], row[width - 1]);
+      }
+      p = eol + 1;
+    }
+  }
+
+  // fitMultiple
+  // Fit a file of rows, cut into line aligned byte ranges, one per
+  // thread, whose equations are merged before solving.
+  bool fitMultiple(const char *file, size_t predictors, unsigned threads, MultipleFit *fit)
+  {
+    const size_t MIN_CHUNK = 1 << 20;
+    if (!predictors) {
+      return false;
+    }
+    InputFile in;
+    vector<char> buffer;
+    {
+      STATS_TIMER(STATS_OPEN);
+      if (!in.open(file)) {
+        return false;
+      }
+      if (!in.isMapped() && !in.readAll(&buffer)) {
+        return false;
+      }
+    }
+    const char *begin = in.isMapped() ? in.data() : buffer.data();
+    size_t size = in.isMapped() ? in.size() : buffer.size();
+    const char *end = begin + size;
+    STATS_ADD(bytes, size);
+
+    if (!threads) {
+      threads = std::thread::hardware_concurrency();
+    }
+    threads = std::max(1u, std::min<unsigned>(threads, size / MIN_CHUNK + 1));
+
+    // Cut at even offsets, moving each cut to the start of the next line
+    vector<const char *> cuts(threads + 1);
+    cuts[0] = begin;
+    cuts[threads] = end;
+    for (unsigned i = 1; i < threads; i++) {
+      const char *p = std::max(cuts[i - 1], begin + size / threads * i);
+      const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+      cuts[i] = eol ? eol + 1 : end;
+    }
+
+    vector<NormalEquations> parts(threads, NormalEquations(predictors));
+    {
+      STATS_TIMER(STATS_PARSE);
+      vector<std::thread> workers;
+      for (unsigned i = 1; i < threads; i++) {
+        workers.push_back(std::thread([&parts, &cuts, i]() {
+          sumRows(cuts[i], cuts[i + 1], &parts[i]);
+        }));
+      }
+      sumRows(cuts[0], cuts[1], &parts[0]);
+      for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+      }
+    }
+    return solveFit(&parts, fit);
+  }
+} // namespace hedger
@@ -0,0 +1,114 @@
+// online.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+
+#include "regression.h"
+
+namespace hedger {
+  // add
+  // Fold one point into the means and co-moments.
+  void OnlineFit::add(double x, double y)
+  {
+    n_++;
+    double dx = x - xMean_;
+    xMean_ += dx / n_;
+    double dy = y - yMean_;
+    yMean_ += dy / n_;
+    xM2_ += dx * (x - xMean_);
+    yM2_ += dy * (y - yMean_);
+    coMoment_ += dx * (y - yMean_);
+  }
+
+  // remove
+  // Exact inverse of add: back out the means first, then the co-moment
+  // terms add contributed using the old x̄ and the new ȳ.
+  void OnlineFit::remove(double x, double y)
+  {
+    if (n_ <= 1) {
+      clear();
+      return;
+    }
+    double xWithMean = xMean_, yWithMean = yMean_;
+    n_--;
+    xMean_ -= (x - xMean_) / n_;
+    yMean_ -= (y - yMean_) / n_;
+    xM2_ -= (x - xMean_) * (x - xWithMean);
+    yM2_ -= (y - yMean_) * (y - yWithMean);
+    coMoment_ -= (x - xMean_) * (y - yWithMean);
+    if (xM2_ < 0.0) {
+      xM2_ = 0.0;
+    }
+    if (yM2_ < 0.0) {
+      yM2_ = 0.0;
+    }
+  }
+
+  // merge
+  // Combine two accumulators (Chan et al. pairwise update).
+  void OnlineFit::merge(const OnlineFit &other)
+  {
+    if (!other.n_) {
+      return;
+    }
+    if (!n_) {
+      *this = other;
+      return;
+    }
+    size_t n = n_ + other.n_;
+    double dx = other.xMean_ - xMean_;
+    double dy = other.yMean_ - yMean_;
+    double weight = (double) n_ * other.n_ / n;
+    xMean_ += dx * other.n_ / n;
+    yMean_ += dy * other.n_ / n;
+    xM2_ += other.xM2_ + dx * dx * weight;
+    yM2_ += other.yM2_ + dy * dy * weight;
+    coMoment_ += other.coMoment_ + dx * dy * weight;
+    n_ = n;
+  }
+
+  // sums
+  // Raw sigmas equivalent to the accumulated points.
+  Sums OnlineFit::sums() const
+  {
+    Sums s;
+    s.n = n_;
+    s.x = n_ * xMean_;
+    s.y = n_ * yMean_;
+    s.xSquared = xM2_ + n_ * xMean_ * xMean_;
+    s.xy = coMoment_ + n_ * xMean_ * yMean_;
+    s.ySquared = yM2_ + n_ * yMean_ * yMean_;
+    return s;
+  }
+
+  // getFit
+  // Report the current fit.  m and b come straight from the centered
+  // moments rather than the reconstructed sums, and so do R² and the
+  // standard errors.
+  void OnlineFit::getFit(Fit *fit) const
+  {
+    fit->sums = sums();
+    fit->xMean = xMean_;
+    fit->yMean = yMean_;
+    fit->m = slope();
+    fit->b = baseline();
+    fit->yAtMean = fit->m * fit->xMean + fit->b;
+    getFitStatistics(n_, n_, xM2_, yM2_, coMoment_, fit);
+  }
+
+} // namespace hedger
@@ -0,0 +1,611 @@
+// output.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "stats.h"
+
+using namespace std;
+
+namespace hedger {
+  bool parseOutputFormat(const char *name, OutputFormat *format)
+  {
+    if (!strcmp(name, "json")) {
+      *format = OUTPUT_JSON;
+    } else if (!strcmp(name, "csv")) {
+      *format = OUTPUT_CSV;
+    } else if (!strcmp(name, "bin")) {
+      *format = OUTPUT_BINARY;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  // DiyFp
+  // f × 2ᵉ with a full 64 bit significand, the working number of Grisu.
+  struct DiyFp {
+    DiyFp(uint64_t f, int e) : f(f), e(e) {}
+
+    // DiyFp
+    // Exact value of a positive finite double
+    explicit DiyFp(double d)
+    {
+      uint64_t bits;
+      memcpy(&bits, &d, sizeof(bits));
+      int biased = static_cast<int>(bits >> 52 & 0x7ff);
+      f = bits & (HIDDEN_BIT - 1);
+      if (biased) {
+        f += HIDDEN_BIT;
+        e = biased - EXPONENT_BIAS;
+      } else {
+        e = 1 - EXPONENT_BIAS;    // subnormal
+      }
+    }
+
+    DiyFp operator-(const DiyFp &other) const { return DiyFp(f - other.f, e); }
+
+    // operator*
+    // Upper 64 bits of the 128 bit product, rounded
+    DiyFp operator*(const DiyFp &other) const
+    {
+      const uint64_t M32 = 0xffffffffu;
+      uint64_t a = f >> 32, b = f & M32, c = other.f >> 32, d = other.f & M32;
+      uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+      uint64_t middle = (bd >> 32) + (ad & M32) + (bc & M32) + (1u << 31);
+      return DiyFp(ac + (ad >> 32) + (bc >> 32) + (middle >> 32), e + other.e + 64);
+    }
+
+    DiyFp normalize() const
+    {
+      int shift = __builtin_clzll(f);
+      return DiyFp(f << shift, e - shift);
+    }
+
+    // boundaries
+    // Normalized midpoints to the neighbouring doubles, sharing one
+    // exponent.  The lower gap is half as wide at a power of two.
+    void boundaries(DiyFp *minus, DiyFp *plus) const
+    {
+      *plus = DiyFp((f << 1) + 1, e - 1).normalize();
+      *minus = HIDDEN_BIT == f ? DiyFp((f << 2) - 1, e - 2) : DiyFp((f << 1) - 1, e - 1);
+      minus->f <<= minus->e - plus->e;
+      minus->e = plus->e;
+    }
+
+    static const uint64_t HIDDEN_BIT = uint64_t(1) << 52;
+    static const int EXPONENT_BIAS = 0x3ff + 52;
+
+    uint64_t f;
+    int e;
+  };
+
+  // Normalized 10ᵏ for k = -348, -340, … 340, round to nearest
+  static const uint64_t POWER_F[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+  };
+  static const int16_t POWER_E[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066,
+  };
+
+  // cachedPower
+  // The cached 10⁻ᴷ that scales a number of binary exponent e into
+  // exponent -60 … -32, so its integer part fits 32 bits.
+  // Entry: binary exponent of the upper boundary
+  //        destination decimal exponent K
+  static DiyFp cachedPower(int e, int *k)
+  {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;   // log₁₀ 2
+    int power = static_cast<int>(dk);
+    if (dk - power > 0.0) {
+      power++;
+    }
+    unsigned index = static_cast<unsigned>((power >> 3) + 1);
+    *k = -(-348 + static_cast<int>(index << 3));
+    return DiyFp(POWER_F[index], POWER_E[index]);
+  }
+
+  static const uint32_t POWERS_OF_10[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+  };
+
+  static int decimalDigits(uint32_t n)
+  {
+    int digits = 1;
+    while (digits < 10 && n >= POWERS_OF_10[digits]) {
+      digits++;
+    }
+    return digits;
+  }
+
+  // roundWeed
+  // Step the last digit down while that moves closer to the value and
+  // stays inside the boundaries.
+  static void roundWeed(char *digits, int length, uint64_t delta, uint64_t rest,
+      uint64_t tenKappa, uint64_t distance)
+  {
+    while (rest < distance && delta - rest >= tenKappa &&
+        (rest + tenKappa < distance || distance - rest > rest + tenKappa - distance)) {
+      digits[length - 1]--;
+      rest += tenKappa;
+    }
+  }
+
+  // generateDigits
+  // Digits of the scaled upper boundary, stopping as soon as what is
+  // left is within delta, that is as soon as the digits so far already
+  // identify the double.
+  // Entry: scaled value, upper boundary and boundary width
+  //        destination digits and count
+  //        decimal exponent K, adjusted for the digits cut off
+  static void generateDigits(const DiyFp &w, const DiyFp &plus, uint64_t delta,
+      char *digits, int *length, int *k)
+  {
+    const DiyFp one(uint64_t(1) << -plus.e, plus.e);
+    uint64_t distance = (plus - w).f;
+    uint32_t p1 = static_cast<uint32_t>(plus.f >> -one.e);
+    uint64_t p2 = plus.f & (one.f - 1);
+    int kappa = decimalDigits(p1);
+    *length = 0;
+    while (kappa > 0) {
+      uint32_t power = POWERS_OF_10[kappa - 1];
+      uint32_t d = p1 / power;
+      p1 %= power;
+      if (d || *length) {
+        digits[(*length)++] = static_cast<char>('0' + d);
+      }
+      kappa--;
+      uint64_t rest = (static_cast<uint64_t>(p1) << -one.e) + p2;
+      if (rest <= delta) {
+        *k += kappa;
+        roundWeed(digits, *length, delta, rest, static_cast<uint64_t>(power) << -one.e, distance);
+        return;
+      }
+    }
+    // Fractional digits; distance is scaled with delta, which it never
+    // exceeds, so neither overflows however many digits this takes
+    for (;;) {
+      p2 *= 10;
+      delta *= 10;
+      distance *= 10;
+      char d = static_cast<char>(p2 >> -one.e);
+      if (d || *length) {
+        digits[(*length)++] = static_cast<char>('0' + d);
+      }
+      p2 &= one.f - 1;
+      kappa--;
+      if (p2 < delta) {
+        *k += kappa;
+        roundWeed(digits, *length, delta, p2, one.f, distance);
+        return;
+      }
+    }
+  }
+
+  // grisu2
+  // Entry: positive finite value
+  //        destination digits, 17 at most
+  //        destination # of digits
+  //        destination decimal exponent; value ≈ digits × 10ᴷ
+  static void grisu2(double value, char *digits, int *length, int *k)
+  {
+    DiyFp v(value);
+    DiyFp minus(0, 0), plus(0, 0);
+    v.boundaries(&minus, &plus);
+    DiyFp power = cachedPower(plus.e, k);
+    DiyFp w = v.normalize() * power;
+    DiyFp upper = plus * power, lower = minus * power;
+    // One unit in from each side covers the rounding of the products
+    upper.f--;
+    lower.f++;
+    generateDigits(w, upper, upper.f - lower.f, digits, length, k);
+  }
+
+  static char *writeExponent(int e, char *p)
+  {
+    *p++ = 'e';
+    if (e < 0) {
+      *p++ = '-';
+      e = -e;
+    }
+    if (e >= 100) {
+      *p++ = static_cast<char>('0' + e / 100);
+      e %= 100;
+      *p++ = static_cast<char>('0' + e / 10);
+    } else if (e >= 10) {
+      *p++ = static_cast<char>('0' + e / 10);
+    }
+    *p++ = static_cast<char>('0' + e % 10);
+    return p;
+  }
+
+  size_t formatDouble(double value, char *buffer)
+  {
+    char *p = buffer;
+    if (isnan(value)) {
+      memcpy(p, "nan", 3);
+      return 3;
+    }
+    if (signbit(value)) {
+      *p++ = '-';
+      value = -value;
+    }
+    if (isinf(value)) {
+      memcpy(p, "inf", 3);
+      return p + 3 - buffer;
+    }
+    if (0.0 == value) {
+      *p++ = '0';
+      return p - buffer;
+    }
+
+    char digits[20];
+    int length, k;
+    grisu2(value, digits, &length, &k);
+
+    // point is where the decimal point falls among the digits
+    int point = length + k;
+    if (k >= 0 && point <= 21) {
+      // 1234e7 → 12340000000
+      memcpy(p, digits, length);
+      memset(p + length, '0', k);
+      p += point;
+    } else if (point > 0 && point <= 21) {
+      // 1234e-2 → 12.34
+      memcpy(p, digits, point);
+      p[point] = '.';
+      memcpy(p + point + 1, digits + point, length - point);
+      p += length + 1;
+    } else if (point > -6 && point <= 0) {
+      // 1234e-6 → 0.001234
+      *p++ = '0';
+      *p++ = '.';
+      memset(p, '0', -point);
+      p += -point;
+      memcpy(p, digits, length);
+      p += length;
+    } else {
+      // 1234e30 → 1.234e33
+      *p++ = digits[0];
+      if (length > 1) {
+        *p++ = '.';
+        memcpy(p, digits + 1, length - 1);
+        p += length - 1;
+      }
+      p = writeExponent(point - 1, p);
+    }
+    return p - buffer;
+  }
+
+  // Output buffered before a write
+  static const size_t OUTPUT_BLOCK = 1 << 20;
+
+  OutputWriter::OutputWriter(int fd, OutputFormat format) :
+    fd_(fd), format_(format), buffer_(OUTPUT_BLOCK), size_(0),
+    record_(RECORD_NONE), fields_(0), ok_(true) {}
+
+  OutputWriter::~OutputWriter()
+  {
+    flush();
+  }
+
+  bool OutputWriter::flush()
+  {
+    writeAll(buffer_.data(), size_);
+    size_ = 0;
+    return ok_;
+  }
+
+  // writeAll
+  // Write through short writes and interrupts; after a failure nothing
+  // more is written
+  void OutputWriter::writeAll(const char *p, size_t size)
+  {
+    while (ok_ && size) {
+      ssize_t n = ::write(fd_, p, size);
+      if (n < 0 && EINTR == errno) {
+        continue;
+      }
+      if (n <= 0) {
+        ok_ = false;
+        break;
+      }
+      p += n;
+      size -= n;
+    }
+  }
+
+  // reserve
+  // Make room for size more bytes, which must fit in the buffer
+  void OutputWriter::reserve(size_t size)
+  {
+    if (size_ + size > buffer_.size()) {
+      flush();
+    }
+  }
+
+  void OutputWriter::raw(const void *bytes, size_t size)
+  {
+    if (size_ + size > buffer_.size()) {
+      flush();
+      if (size > buffer_.size()) {
+        writeAll(static_cast<const char *>(bytes), size);
+        return;
+      }
+    }
+    memcpy(&buffer_[size_], bytes, size);
+    size_ += size;
+  }
+
+  // begin
+  // Start a record, with a CSV header if the kind of record changed
+  void OutputWriter::begin(Record record, const char *header)
+  {
+    if (OUTPUT_CSV == format_ && record != record_) {
+      raw(header, strlen(header));
+      raw("\n", 1);
+    }
+    record_ = record;
+    fields_ = 0;
+  }
+
+  void OutputWriter::end()
+  {
+    if (OUTPUT_JSON == format_) {
+      raw("}\n", 2);
+    } else if (OUTPUT_CSV == format_) {
+      raw("\n", 1);
+    }
+  }
+
+  // field
+  // Separator and, for JSON, the name of the next field
+  void OutputWriter::field(const char *name)
+  {
+    if (OUTPUT_JSON == format_) {
+      raw(fields_ ? ",\"" : "{\"", 2);
+      raw(name, strlen(name));
+      raw("\":", 2);
+    } else if (OUTPUT_CSV == format_ && fields_) {
+      raw(",", 1);
+    }
+    fields_++;
+  }
+
+  // number
+  // JSON has no NaN or infinity; they are written as null
+  void OutputWriter::number(double value)
+  {
+    if (OUTPUT_BINARY == format_) {
+      raw(&value, sizeof(value));
+      return;
+    }
+    if (OUTPUT_JSON == format_ && !isfinite(value)) {
+      raw("null", 4);
+      return;
+    }
+    reserve(DOUBLE_CHARS);
+    size_ += formatDouble(value, &buffer_[size_]);
+  }
+
+  void OutputWriter::count(uint64_t value)
+  {
+    if (OUTPUT_BINARY == format_) {
+      raw(&value, sizeof(value));
+      return;
+    }
+    char digits[20];
+    size_t length = 0;
+    do {
+      digits[length++] = static_cast<char>('0' + value % 10);
+      value /= 10;
+    } while (value);
+    reserve(length);
+    while (length) {
+      buffer_[size_++] = digits[--length];
+    }
+  }
+
+  // text
+  // Length prefixed in binary, a JSON string, or a CSV field quoted if
+  // it holds a separator, quote or line break
+  void OutputWriter::text(const string &value)
+  {
+    if (OUTPUT_BINARY == format_) {
+      count(value.size());
+      raw(value.data(), value.size());
+      return;
+    }
+    if (OUTPUT_CSV == format_) {
+      if (string::npos == value.find_first_of(",\"\r\n")) {
+        raw(value.data(), value.size());
+        return;
+      }
+      raw("\"", 1);
+      for (size_t i = 0; i < value.size(); i++) {
+        raw(&value[i], 1);
+        if ('"' == value[i]) {
+          raw("\"", 1);
+        }
+      }
+      raw("\"", 1);
+      return;
+    }
+    static const char HEX[] = "0123456789abcdef";
+    raw("\"", 1);
+    for (size_t i = 0; i < value.size(); i++) {
+      unsigned char c = value[i];
+      if ('"' == c || '\\' == c) {
+        char escaped[2] = { '\\', static_cast<char>(c) };
+        raw(escaped, 2);
+      } else if (c < 0x20) {
+        char escaped[6] = { '\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 15] };
+        raw(escaped, 6);
+      } else {
+        raw(&value[i], 1);
+      }
+    }
+    raw("\"", 1);
+  }
+
+  void OutputWriter::writeFit(const Fit &fit)
+  {
+    STATS_TIMER(STATS_OUTPUT);
+    begin(RECORD_FIT, "n,b,m,x_mean,y_at_mean,r2,s2,se_b,se_m");
+    field("n");
+    count(fit.sums.n);
+    field("b");
+    number(fit.b);
+    field("m");
+    number(fit.m);
+    field("x_mean");
+    number(fit.xMean);
+    field("y_at_mean");
+    number(fit.yAtMean);
+    field("r2");
+    number(fit.r2);
+    field("s2");
+    number(fit.residualVariance);
+    field("se_b");
+    number(fit.baselineError);
+    field("se_m");
+    number(fit.slopeError);
+    end();
+  }
+
+  void OutputWriter::writeWindowStep(double x, double b, double m)
+  {
+    begin(RECORD_WINDOW, "x,b,m");
+    field("x");
+    number(x);
+    field("b");
+    number(b);
+    field("m");
+    number(m);
+    end();
+  }
+
+  void OutputWriter::writeGroup(const string &key, size_t n, double b, double m)
+  {
+    begin(RECORD_GROUP, "key,n,b,m");
+    field("key");
+    text(key);
+    field("n");
+    count(n);
+    field("b");
+    number(b);
+    field("m");
+    number(m);
+    end();
+  }
+
+  void OutputWriter::writeCoefficients(size_t n, const vector<double> &coefficients)
+  {
+    string header = "n";
+    for (size_t i = 0; i < coefficients.size(); i++) {
+      char name[24];
+      snprintf(name, sizeof(name), ",c%zu", i);
+      header += name;
+    }
+    begin(RECORD_COEFFICIENTS, header.c_str());
+    field("n");
+    count(n);
+    if (OUTPUT_BINARY == format_) {
+      count(coefficients.size());
+    }
+    field("coefficients");
+    if (OUTPUT_JSON == format_) {
+      raw("[", 1);
+    }
+    for (size_t i = 0; i < coefficients.size(); i++) {
+      if (i && OUTPUT_BINARY != format_) {
+        raw(",", 1);
+      }
+      number(coefficients[i]);
+    }
+    if (OUTPUT_JSON == format_) {
+      raw("]", 1);
+    }
+    end();
+  }
+
+  void OutputWriter::writeSample(const SampledFit &fit)
+  {
+    STATS_TIMER(STATS_OUTPUT);
+    begin(RECORD_SAMPLE, "n,rows,b,m,b_interval,m_interval,x_mean,r2");
+    field("n");
+    count(fit.fit.sums.n);
+    field("rows");
+    count(fit.rows);
+    field("b");
+    number(fit.fit.b);
+    field("m");
+    number(fit.fit.m);
+    field("b_interval");
+    number(fit.bInterval);
+    field("m_interval");
+    number(fit.mInterval);
+    field("x_mean");
+    number(fit.fit.xMean);
+    field("r2");
+    number(fit.fit.r2);
+    end();
+  }
+} // namespace hedger
@@ -0,0 +1,116 @@
+// output.h
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+// Internal machine readable output for the command line front end:
+// JSON lines, CSV with a header, or packed native endian records, built
+// in one large buffer and written with write(2).
+//
+// Binary records, all 8 byte fields:
+//   fit          n (uint64) b m x̄ ȳ(x̄) R² s² σb σm
+//   window step  x b m
+//   group        key length (uint64) key bytes, then n (uint64) b m
+//   coefficients n (uint64) count (uint64) coefficients
+//   sample       n rows (uint64) b m b± m± x̄ R²
+//
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "regression.h"
+
+namespace hedger {
+  enum OutputFormat {
+    OUTPUT_TEXT,
+    OUTPUT_JSON,
+    OUTPUT_CSV,
+    OUTPUT_BINARY
+  };
+
+  // parseOutputFormat
+  // Entry: format name, json, csv or bin
+  //        destination format
+  // Exit: true if the name is known
+  bool parseOutputFormat(const char *name, OutputFormat *format);
+
+  // Room formatDouble needs, sign and terminator included
+  static const size_t DOUBLE_CHARS = 32;
+
+  // formatDouble
+  // Digits that read back to the same double (Grisu2), as fixed point
+  // unless the exponent is large; "nan", "inf", "-inf".  Usually the
+  // shortest such digits, but not always: 1e23 is 9.999999999999999e22.
+  // Entry: value
+  //        buffer of at least DOUBLE_CHARS
+  // Exit: # of characters written, not terminated
+  size_t formatDouble(double value, char *buffer);
+
+  // OutputWriter
+  // Records in one of the machine formats.  CSV gets a header line
+  // before the first record, or whenever the kind of record changes.
+  class OutputWriter {
+  public:
+    OutputWriter(int fd, OutputFormat format);
+    ~OutputWriter();
+
+    void writeFit(const Fit &fit);
+    void writeWindowStep(double x, double b, double m);
+    void writeGroup(const std::string &key, size_t n, double b, double m);
+    void writeCoefficients(size_t n, const std::vector<double> &coefficients);
+    void writeSample(const SampledFit &fit);
+
+    // flush
+    // Exit: false if any write so far failed
+    bool flush();
+
+  private:
+    enum Record {
+      RECORD_NONE,
+      RECORD_FIT,
+      RECORD_WINDOW,
+      RECORD_GROUP,
+      RECORD_COEFFICIENTS,
+      RECORD_SAMPLE
+    };
+
+    void begin(Record record, const char *header);
+    void end();
+    void field(const char *name);
+    void number(double value);
+    void count(uint64_t value);
+    void text(const std::string &value);
+    void raw(const void *bytes, size_t size);
+    void reserve(size_t size);
+    void writeAll(const char *p, size_t size);
+
+    int fd_;
+    OutputFormat format_;
+    std::vector<char> buffer_;
+    size_t size_;
+    Record record_;     // kind of the last record, for CSV headers
+    size_t fields_;     // fields so far in the current record
+    bool ok_;
+  };
+} // namespace hedger
+
+#endif // OUTPUT_H
@@ -0,0 +1,577 @@
+// parse.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "regression.h"
+#include "pipeline.h"
+#include "scanner.h"
+
+using namespace std;
+
+namespace hedger {
+  // parseDouble
+  // Parse a decimal floating point number in place, without copying or
+  // consulting the locale.  Numbers of up to 19 significant digits whose
+  // decimal exponent is within ±22 are converted exactly with a single
+  // multiply or divide; anything longer is handed to strtod.
+  // Entry: pointer to first character
+  //        pointer one past the last character available
+  //        pointer to destination double
+  // Exit: pointer past the last character consumed, or the first
+  //       argument if no number could be read
+  const char *parseDouble(const char *p, const char *end, double *d)
+  {
+    static const double POW10[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const int MAX_MANTISSA_DIGITS = 19;
+    const char *s = p;
+    bool negative = false;
+    if (s < end && '-' == *s) {
+      negative = true;
+      s++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;     // significant digits held in mantissa
+    int exponent = 0;   // decimal exponent applied to mantissa
+    bool any = false;   // saw at least one digit
+    bool inexact = false;
+    for (; s < end && isDigit(*s); s++) {
+      any = true;
+      if (digits < MAX_MANTISSA_DIGITS) {
+        mantissa = mantissa * 10 + (*s - '0');
+        digits += (0 != mantissa);
+      } else {
+        exponent++;
+        inexact |= ('0' != *s);
+      }
+    }
+    if (s < end && '.' == *s) {
+      s++;
+      for (; s < end && isDigit(*s); s++) {
+        any = true;
+        if (digits < MAX_MANTISSA_DIGITS) {
+          mantissa = mantissa * 10 + (*s - '0');
+          digits += (0 != mantissa);
+          exponent--;
+        } else {
+          inexact |= ('0' != *s);
+        }
+      }
+    }
+    if (!any) {
+      return p;
+    }
+
+    // Optional exponent; only consumed if digits follow it
+    if (s < end && ('e' == *s || 'E' == *s)) {
+      const char *e = s + 1;
+      bool negativeExp = false;
+      if (e < end && ('-' == *e || '+' == *e)) {
+        negativeExp = ('-' == *e);
+        e++;
+      }
+      if (e < end && isDigit(*e)) {
+        int value = 0;
+        for (; e < end && isDigit(*e); e++) {
+          if (value < 100000) {
+            value = value * 10 + (*e - '0');
+          }
+        }
+        exponent += negativeExp ? -value : value;
+        s = e;
+      }
+    }
+
+    if (!inexact && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+      double v = (double) mantissa;
+      if (exponent < 0) {
+        v /= POW10[-exponent];
+      } else {
+        v *= POW10[exponent];
+      }
+      *d = negative ? -v : v;
+    } else {
+      // Slow path; strtod needs a terminated copy
+      string token(p, s - p);
+      *d = strtod(token.c_str(), NULL);
+    }
+    return s;
+  }
+
+  // estimatePoints
+  // Guess how many points a file holds from the number density of its
+  // first block, so a parse can allocate once instead of growing.  The
+  // guess is padded; memory past the last point is never touched.
+  // Entry: open input
+  // Exit: estimated points, or 0 if the input is not mapped
+  static size_t estimatePoints(const InputFile &in)
+  {
+    const size_t SAMPLE = 1 << 16;
+    if (!in.isMapped() || !in.size()) {
+      return 0;
+    }
+    // Count tokens the way scanBuffer splits them
+    size_t sample = std::min(SAMPLE, in.size()), tokens = 0;
+    bool inToken = false;
+    for (const char *p = in.data(); p < in.data() + sample; p++) {
+      if (inToken) {
+        inToken = isTokenChar(*p);
+      } else if (isTokenStart(*p)) {
+        inToken = true;
+        tokens++;
+      }
+    }
+    double perByte = (double) tokens / sample;
+    return (size_t) (perByte * in.size() / 2 * 1.125) + 16;
+  }
+
+  // estimateLines
+  // estimatePoints for field selection, where each line is one point
+  static size_t estimateLines(const InputFile &in)
+  {
+    const size_t SAMPLE = 1 << 16;
+    if (!in.isMapped() || !in.size()) {
+      return 0;
+    }
+    size_t sample = std::min(SAMPLE, in.size());
+    size_t lines = std::count(in.data(), in.data() + sample, '\n');
+    return (size_t) ((double) lines / sample * in.size() * 1.125) + 16;
+  }
+
+  // PointBuffer
+  // Scanner sink that writes alternating x and y straight into a DataPoint
+  // buffer, doubling it whenever the estimate falls short.
+  struct PointBuffer {
+    PointBuffer(size_t capacity) :
+      capacity(capacity ? capacity : 1024), size(0), points(new DataPoint[this->capacity]),
+      x(0.0), xy(false) {}
+    void operator()(double d)
+    {
+      if (xy) {
+        if (size == capacity) {
+          STATS_TIMER(STATS_COPY);
+          std::unique_ptr<DataPoint[]> grown(new DataPoint[capacity * 2]);
+          memcpy(grown.get(), points.get(), size * sizeof(DataPoint));
+          points.swap(grown);
+          capacity *= 2;
+        }
+        points[size].x = x;
+        points[size].y = d;
+        size++;
+      } else {
+        x = d;
+      }
+      xy ^= true; // Toggle x/y
+    }
+    size_t capacity;
+    size_t size;
+    std::unique_ptr<DataPoint[]> points;
+    double x;   // x waiting for its y
+    bool xy;
+  };
+
+  // parseFile
+  // Parses a CSV or other non-numeric value separated file and gets the data into an array of DataPoints.
+  // Entry: filename
+  //        pointer to destination point count
+  // Exit: DataPoint array, empty on failure
+  std::unique_ptr<DataPoint[]> parseFile(const char *file, size_t *size) {
+    InputFile in;
+    {
+      STATS_TIMER(STATS_OPEN);
+      if (!in.open(file)) {
+        return std::unique_ptr<DataPoint[]>();
+      }
+    }
+    PointBuffer buffer(estimatePoints(in));
+    if (!scanInput(in, buffer)) {
+      return std::unique_ptr<DataPoint[]>();
+    }
+    *size = buffer.size;
+    return std::move(buffer.points);
+  }
+
+  // DataSetCollector
+  // Scanner sink that appends alternating x and y straight to a DataSet.
+  struct DataSetCollector {
+    DataSetCollector(DataSet *data) : data(data), x(0.0), xy(false), ok(true) {}
+    void operator()(double d)
+    {
+      if (xy) {
+        ok &= data->add(x, d);
+      } else {
+        x = d;
+      }
+      xy ^= true; // Toggle x/y
+    }
+    DataSet *data;
+    double x;   // x waiting for its y
+    bool xy;
+    bool ok;
+  };
+
+  // parseFile
+  // Parses a CSV or other non-numeric value separated file straight into
+  // the columns of a data set, replacing its contents.
+  // Entry: filename
+  //        pointer to destination data set
+  // Exit: true on success
+  bool parseFile(const char *file, DataSet *data) {
+    data->clear();
+    InputFile in;
+    {
+      STATS_TIMER(STATS_OPEN);
+      if (!in.open(file)) {
+        return false;
+      }
+    }
+    if (!data->reserve(estimatePoints(in))) {
+      return false;
+    }
+    DataSetCollector collector(data);
+    return scanInput(in, collector) && collector.ok;
+  }
+
+  // parseFile
+  // Parse the selected fields of each line of a delimited file into a
+  // data set, replacing its contents.
+  // Entry: filename, or "-" for standard input
+  //        fields holding x and y
+  //        pointer to destination data set
+  // Exit: true on success
+  bool parseFile(const char *file, const Fields &fields, DataSet *data) {
+    data->clear();
+    InputFile in;
+    {
+      STATS_TIMER(STATS_OPEN);
+      if (!in.open(file)) {
+        return false;
+      }
+    }
+    if (!data->reserve(estimateLines(in))) {
+      return false;
+    }
+    DataSetCollector collector(data);
+    return scanInput(in, fields, collector) && collector.ok;
+  }
+
+  // SumsCollector
+  // Scanner sink that folds alternating x and y straight into running sums.
+  struct SumsCollector {
+    SumsCollector(bool swap) : x(0.0), xy(false), swap(swap) {}
+    void operator()(double d)
+    {
+      if (xy) {
+        if (swap) {
+          sums.add(d, x);
+        } else {
+          sums.add(x, d);
+        }
+      } else {
+        x = d;
+      }
+      xy ^= true; // Toggle x/y
+    }
+    Sums sums;
+    double x;   // x waiting for its y
+    bool xy;
+    bool swap;
+  };
+
+  // pipelineInput
+  // Run an open input through the pipeline, reading mapped input from the
+  // mapping in blocks.
+  static bool pipelineInput(InputFile *in, bool swap, Sums *sums)
+  {
+    STATS_TIMER(STATS_PARSE);
+    if (in->isMapped()) {
+      size_t offset = 0;
+      return pipelineSums([in, &offset](char *buffer, size_t size) -> ssize_t {
+        size = std::min(size, in->size() - offset);
+        memcpy(buffer, in->data() + offset, size);
+        offset += size;
+        return size;
+      }, swap, sums);
+    }
+    return pipelineSums([in](char *buffer, size_t size) {
+      return in->read(buffer, size);
+    }, swap, sums);
+  }
+
+  // streamInput
+  // streamFile on an open input.  Input that has to be read, not mapped,
+  // overlaps I/O with parsing when there are cores to spare.
+  static bool streamInput(InputFile *in, bool swap, Sums *sums)
+  {
+    if (!in->isMapped() && std::thread::hardware_concurrency() > 1) {
+      return pipelineInput(in, swap, sums);
+    }
+    SumsCollector collector(swap);
+    if (!scanInput(*in, collector)) {
+      return false;
+    }
+    *sums = collector.sums;
+    return true;
+  }
+
+  // streamFile
+  // Single pass over a file that accumulates the best fit sums without
+  // keeping any of the points, so memory use is independent of file size.
+  // Entry: filename, or "-" for standard input
+  //        true to swap x and y values
+  //        pointer to destination sums
+  // Exit: true on success
+  bool streamFile(const char *file, bool swap, Sums *sums)
+  {
+    InputFile in;
+    {
+      STATS_TIMER(STATS_OPEN);
+      if (!in.open(file)) {
+        return false;
+      }
+    }
+    return streamInput(&in, swap, sums);
+  }
+
+  // streamFile
+  // streamFile over the selected fields of each line.  It always runs on
+  // the calling thread; swap x and y by swapping the fields.
+  // Entry: filename, or "-" for standard input
+  //        fields holding x and y
+  //        pointer to destination sums
+  // Exit: true on success
+  bool streamFile(const char *file, const Fields &fields, Sums *sums)
+  {
+    InputFile in;
+    {
+      STATS_TIMER(STATS_OPEN);
+      if (!in.open(file)) {
+        return false;
+      }
+    }
+    SumsCollector collector(false);
+    if (!scanInput(in, fields, collector)) {
+      return false;
+    }
+    *sums = collector.sums;
+    return true;
+  }
+
+  // streamFilePipelined
+  // streamFile with reading, tokenizing and summing on three threads
+  // whatever the input.
+  // Entry: filename, or "-" for standard input
+  //        true to swap x and y values
+  //        pointer to destination sums
+  // Exit: true on success
+  bool streamFilePipelined(const char *file, bool swap, Sums *sums)
+  {
+    InputFile in;
+    {
+      STATS_TIMER(STATS_OPEN);
+      if (!in.open(file)) {
+        return false;
+      }
+    }
+    return pipelineInput(&in, swap, sums);
+  }
+
+  // PointCollector
+  // Scanner sink that pairs the number stream and passes each point on.
+  struct PointCollector {
+    PointCollector(bool swap, PointCallback callback, void *context)
+      : x(0.0), xy(false), swap(swap), callback(callback), context(context) {}
+    void operator()(double d)
+    {
+      if (xy) {
+        if (swap) {
+          callback(d, x, context);
+        } else {
+          callback(x, d, context);
+        }
+      } else {
+        x = d;
+      }
+      xy ^= true; // Toggle x/y
+    }
+    double x;   // x waiting for its y
+    bool xy;
+    bool swap;
+    PointCallback callback;
+    void *context;
+  };
+
+  // streamPoints
+  // Single pass over a file that hands each point to a callback in file
+  // order without storing any of them.
+  // Entry: filename, or "-" for standard input
+  //        true to swap x and y values
+  //        callback, called as callback(x, y, context)
+  //        opaque context pointer for the callback
+  // Exit: true on success
+  bool streamPoints(const char *file, bool swap, PointCallback callback, void *context)
+  {
+    PointCollector collector(swap, callback, context);
+    return scanFile(file, collector);
+  }
+
+  // streamPoints
+  // streamPoints over the selected fields of each line.
+  // Entry: filename, or "-" for standard input
+  //        fields holding x and y
+  //        callback, called as callback(x, y, context)
+  //        opaque context pointer for the callback
+  // Exit: true on success
+  bool streamPoints(const char *file, const Fields &fields, PointCallback callback, void *context)
+  {
+    InputFile in;
+    {
+      STATS_TIMER(STATS_OPEN);
+      if (!in.open(file)) {
+        return false;
+      }
+    }
+    PointCollector collector(false, callback, context);
+    return scanInput(in, fields, collector);
+  }
+
+  // ChunkCollector
+  // Scanner sink for one byte range of a file summed in parallel.  A chunk
+  // can not know whether its first number is an x or a y, so pairs are
+  // summed for both alignments and the right set is picked when chunks
+  // are combined in file order.
+  struct ChunkCollector {
+    ChunkCollector(bool swap) : count(0), first(0.0), last(0.0), swap(swap) {}
+    void operator()(double d)
+    {
+      if (0 == count) {
+        first = d;
+      } else if (swap) {
+        pairs[(count - 1) & 1].add(d, last);
+      } else {
+        pairs[(count - 1) & 1].add(last, d);
+      }
+      last = d;
+      count++;
+    }
+    Sums pairs[2];  // [0] pairs numbers 0-1, 2-3...; [1] pairs 1-2, 3-4...
+    size_t count;
+    double first;
+    double last;
+    bool swap;
+  };
+
+  // sumFileParallel
+  // Parse a file and accumulate the best fit sums across several threads.
+  // The mapped file is cut into byte ranges that each end on a separator,
+  // every thread scans one range into partial sums, and the partials are
+  // reduced in order, carrying an unpaired trailing x into the next range.
+  // Inputs that can not be mapped are streamed on the calling thread.
+  // Entry: filename
+  //        true to swap x and y values
+  //        # of threads, 0 for one per hardware thread
+  //        pointer to destination sums
+  // Exit: true on success
+  bool sumFileParallel(const char *file, bool swap, unsigned threads, Sums *sums)
+  {
+    const size_t MIN_CHUNK = 1 << 20;
+    InputFile in;
+    {
+      STATS_TIMER(STATS_OPEN);
+      if (!in.open(file)) {
+        return false;
+      }
+    }
+    if (!in.isMapped()) {
+      return streamInput(&in, swap, sums);
+    }
+    STATS_TIMER(STATS_PARSE);
+    STATS_ADD(bytes, in.size());
+
+    if (!threads) {
+      threads = std::thread::hardware_concurrency();
+    }
+    size_t size = in.size();
+    threads = std::max(1u, std::min<unsigned>(threads, size / MIN_CHUNK + 1));
+
+    // Cut at even offsets, moving each cut forward off any token
+    const char *begin = in.data(), *end = begin + size;
+    vector<const char *> cuts(threads + 1);
+    cuts[0] = begin;
+    cuts[threads] = end;
+    for (unsigned i = 1; i < threads; i++) {
+      const char *p = std::max(cuts[i - 1], begin + size / threads * i);
+      while (p < end && isTokenChar(*p)) {
+        p++;
+      }
+      cuts[i] = p;
+    }
+
+    vector<ChunkCollector> chunks(threads, ChunkCollector(swap));
+    vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; i++) {
+      workers.push_back(std::thread([&chunks, &cuts, i]() {
+        scanBuffer(cuts[i], cuts[i + 1], true, chunks[i]);
+      }));
+    }
+    scanBuffer(cuts[0], cuts[1], true, chunks[0]);
+    for (size_t i = 0; i < workers.size(); i++) {
+      workers[i].join();
+    }
+
+    // Reduce in file order
+    Sums total;
+    bool pending = false;   // last chunk ended on an unpaired x
+    double carry = 0.0;
+    for (unsigned i = 0; i < threads; i++) {
+      const ChunkCollector &c = chunks[i];
+      if (!c.count) {
+        continue;
+      }
+      if (pending) {
+        // This chunk starts on a y
+        if (swap) {
+          total.add(c.first, carry);
+        } else {
+          total.add(carry, c.first);
+        }
+        total.merge(c.pairs[1]);
+        pending = (c.count - 1) & 1;
+      } else {
+        total.merge(c.pairs[0]);
+        pending = c.count & 1;
+      }
+      carry = c.last;
+    }
+    *sums = total;
+    return true;
+  }
+
+} // namespace hedger
@@ -0,0 +1,192 @@
+// pipeline.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pipeline.h"
+#include "scanner.h"
+#include "stats.h"
+
+using namespace std;
+
+namespace hedger {
+  static const size_t BYTE_BLOCK = 1 << 22;    // bytes per read block
+  static const size_t POINT_BLOCK = 1 << 16;   // points per summing batch
+  static const size_t BLOCKS = 4;              // blocks in flight per stage
+
+  struct ByteBlock {
+    vector<char> bytes;
+    size_t size;
+    bool last;    // end of input; no more blocks follow
+    bool error;
+  };
+
+  struct PointBlock {
+    vector<DataPoint> points;
+    size_t size;
+    bool last;
+    bool error;
+  };
+
+  // Each stage hands full blocks forward and gets empty ones back, so the
+  // blocks are allocated once and cycle between neighbouring stages.
+  typedef SpscQueue<ByteBlock *, BLOCKS + 1> ByteQueue;
+  typedef SpscQueue<PointBlock *, BLOCKS + 1> PointQueue;
+
+  // PointSink
+  // Scanner sink pairing numbers into point blocks for the summing stage.
+  struct PointSink {
+    PointSink(bool swap, PointQueue *empty, PointQueue *full) :
+      x(0.0), xy(false), swap(swap), empty(empty), full(full), block(empty->pop())
+    {
+      block->size = 0;
+    }
+    void operator()(double d)
+    {
+      if (xy) {
+        DataPoint &point = block->points[block->size++];
+        point.x = swap ? d : x;
+        point.y = swap ? x : d;
+        if (POINT_BLOCK == block->size) {
+          send(false, false);
+        }
+      } else {
+        x = d;
+      }
+      xy ^= true; // Toggle x/y
+    }
+    // send
+    // Pass the current block on, then start the next unless it was the last
+    void send(bool last, bool error)
+    {
+      block->last = last;
+      block->error = error;
+      full->push(block);
+      if (!last) {
+        block = empty->pop();
+        block->size = 0;
+      }
+    }
+    double x;   // x waiting for its y
+    bool xy;
+    bool swap;
+    PointQueue *empty, *full;
+    PointBlock *block;
+  };
+
+  // readStage
+  // Hand on whatever each large read returns until the input ends or
+  // fails, so a slow pipe is parsed as it trickles in rather than once a
+  // whole block has arrived.
+  static void readStage(const BlockReader &read, ByteQueue *empty, ByteQueue *full)
+  {
+    for (;;) {
+      ByteBlock *block = empty->pop();
+      ssize_t n = read(block->bytes.data(), block->bytes.size());
+      block->size = n > 0 ? n : 0;
+      block->last = n <= 0;
+      block->error = n < 0;
+      STATS_ADD(bytes, block->size);
+      full->push(block);
+      if (block->last) {
+        return;
+      }
+    }
+  }
+
+  // parseStage
+  // Tokenize blocks as they arrive.  A token cut by a block boundary is
+  // carried over and completed from the start of the next block.  After
+  // an error the remaining blocks are still drained so the reader can
+  // finish.
+  static void parseStage(ByteQueue *emptyBytes, ByteQueue *fullBytes, PointSink *sink)
+  {
+    string carry;
+    bool failed = false;
+    for (;;) {
+      ByteBlock *block = fullBytes->pop();
+      bool last = block->last;
+      failed |= block->error;
+      const char *p = block->bytes.data(), *end = p + block->size;
+      if (!failed && !carry.empty()) {
+        while (p < end && isTokenChar(*p)) {
+          carry.push_back(*p++);
+        }
+        if (p < end || last) {
+          scanBuffer(carry.data(), carry.data() + carry.size(), true, *sink);
+          carry.clear();
+        }
+      }
+      if (!failed && (p < end || last)) {
+        const char *rest = scanBuffer(p, end, last, *sink);
+        carry.append(rest, end);
+      }
+      // Error; a single token longer than a whole block
+      failed |= carry.size() > BYTE_BLOCK;
+      emptyBytes->push(block);
+      if (last) {
+        sink->send(true, failed);
+        return;
+      }
+    }
+  }
+
+  // pipelineSums
+  // Reader and parser run on their own threads; the calling thread sums
+  // each block of points with the vector kernels and merges the results.
+  bool pipelineSums(const BlockReader &read, bool swap, Sums *sums)
+  {
+    vector<ByteBlock> byteBlocks(BLOCKS);
+    vector<PointBlock> pointBlocks(BLOCKS);
+    ByteQueue emptyBytes, fullBytes;
+    PointQueue emptyPoints, fullPoints;
+    for (size_t i = 0; i < BLOCKS; i++) {
+      byteBlocks[i].bytes.resize(BYTE_BLOCK);
+      emptyBytes.push(&byteBlocks[i]);
+      pointBlocks[i].points.resize(POINT_BLOCK);
+      emptyPoints.push(&pointBlocks[i]);
+    }
+
+    PointSink sink(swap, &emptyPoints, &fullPoints);
+    std::thread reader(readStage, std::cref(read), &emptyBytes, &fullBytes);
+    std::thread parser(parseStage, &emptyBytes, &fullBytes, &sink);
+
+    Sums total;
+    bool ok = true;
+    for (;;) {
+      PointBlock *block = fullPoints.pop();
+      Sums part;
+      getSums(block->points.data(), block->size, &part);
+      total.merge(part);
+      ok &= !block->error;
+      bool last = block->last;
+      emptyPoints.push(block);
+      if (last) {
+        break;
+      }
+    }
+    reader.join();
+    parser.join();
+    *sums = total;
+    return ok;
+  }
+} // namespace hedger
@@ -0,0 +1,171 @@
+// pipeline.h
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+// Internal read/parse/sum pipeline for input that can not be mapped.
+//
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "regression.h"
+
+namespace hedger {
+  // SpscQueue
+  // Bounded lock-free queue between exactly one producer thread and one
+  // consumer thread.  Holds up to N - 1 items; head and tail live on
+  // separate cache lines so the two sides do not contend.  The blocking
+  // forms spin briefly, then park until the other side moves.
+  template <typename T, size_t N>
+  class SpscQueue {
+  public:
+    SpscQueue() : head_(0), tail_(0), waiters_(0) {}
+
+    // tryPush
+    // Exit: false if the queue is full
+    bool tryPush(const T &item)
+    {
+      if (!put(item)) {
+        return false;
+      }
+      wake();
+      return true;
+    }
+
+    // tryPop
+    // Exit: false if the queue is empty
+    bool tryPop(T *item)
+    {
+      if (!take(item)) {
+        return false;
+      }
+      wake();
+      return true;
+    }
+
+    // Blocking forms; stages only wait when the one beside them is behind
+    void push(const T &item)
+    {
+      wait([this, &item]() { return put(item); });
+    }
+    T pop()
+    {
+      T item;
+      wait([this, &item]() { return take(&item); });
+      return item;
+    }
+
+  private:
+    SpscQueue(const SpscQueue &);
+    SpscQueue &operator=(const SpscQueue &);
+
+    bool put(const T &item)
+    {
+      size_t tail = tail_.load(std::memory_order_relaxed);
+      size_t next = (tail + 1) % N;
+      if (next == head_.load(std::memory_order_acquire)) {
+        return false;
+      }
+      slots_[tail] = item;
+      tail_.store(next, std::memory_order_release);
+      return true;
+    }
+
+    bool take(T *item)
+    {
+      size_t head = head_.load(std::memory_order_relaxed);
+      if (head == tail_.load(std::memory_order_acquire)) {
+        return false;
+      }
+      *item = slots_[head];
+      head_.store((head + 1) % N, std::memory_order_release);
+      return true;
+    }
+
+    // Yields before parking: enough to ride out a neighbour finishing a
+    // block, short enough not to burn a core while it reads or parses one
+    static const unsigned SPINS = 64;
+
+    // wait
+    // Retry put or take, parking on the condition once the spins run out,
+    // then wake the other side
+    template <typename F>
+    void wait(F attempt)
+    {
+      bool done = false;
+      for (unsigned spins = 0; !done && spins < SPINS; spins++) {
+        done = attempt();
+        if (!done) {
+          std::this_thread::yield();
+        }
+      }
+      if (!done) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        waiters_.fetch_add(1);
+        // Pairs with the fence in wake(): either this attempt sees the
+        // other side's move or the other side sees the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!attempt()) {
+          moved_.wait(lock);
+        }
+        waiters_.fetch_sub(1);
+      }
+      wake();
+    }
+
+    // wake
+    // Unpark the other side after a move, if it is parked
+    void wake()
+    {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (waiters_.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        moved_.notify_all();
+      }
+    }
+
+    alignas(64) std::atomic<size_t> head_;   // next slot to pop
+    alignas(64) std::atomic<size_t> tail_;   // next slot to push
+    alignas(64) std::atomic<unsigned> waiters_;
+    std::mutex mutex_;
+    std::condition_variable moved_;
+    T slots_[N];
+  };
+
+  // Reader stage source: fill a buffer, returning the bytes read, 0 at the
+  // end of input or -1 on error
+  typedef std::function<ssize_t(char *buffer, size_t size)> BlockReader;
+
+  // pipelineSums
+  // Accumulate best fit sums with reading, tokenizing and summing on
+  // three threads.
+  // Entry: source of input bytes
+  //        true to swap x and y values
+  //        pointer to destination sums
+  // Exit: true on success
+  bool pipelineSums(const BlockReader &read, bool swap, Sums *sums);
+} // namespace hedger
+
+#endif // PIPELINE_H
@@ -0,0 +1,271 @@
+// poly.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+// Polynomial fits from power sums.
+//
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "regression.h"
+#include "scanner.h"
+#include "stats.h"
+
+using namespace std;
+
+namespace hedger {
+  PowerSums::PowerSums(size_t degree) :
+    degree_(degree), n_(0), shift_(0.0), shifted_(false),
+    x_((2 * degree + 1) * LANES), xy_((degree + 1) * LANES), yy_(LANES) {}
+
+  void PowerSums::setShift(double shift)
+  {
+    if (!n_) {
+      shift_ = shift;
+      shifted_ = true;
+    }
+  }
+
+  // add
+  // Walk the powers of LANES points at once.  Each lane owns its own
+  // accumulators and there is no sum across lanes inside the loop, so
+  // the lane loops map straight onto vector registers.
+  void PowerSums::add(const double *x, const double *y, size_t size)
+  {
+    if (!shifted_ && size) {
+      setShift(x[0]);
+    }
+    const double shift = shift_;
+    size_t powers = 2 * degree_ + 1;
+    size_t i = 0;
+    for (; i + LANES <= size; i += LANES) {
+      double p[LANES], t[LANES], yl[LANES];
+      for (size_t l = 0; l < LANES; l++) {
+        p[l] = 1.0;
+        t[l] = x[i + l] - shift;
+        yl[l] = y[i + l];
+        yy_[l] += yl[l] * yl[l];
+      }
+      for (size_t k = 0; k < powers; k++) {
+        double *sx = &x_[k * LANES];
+        for (size_t l = 0; l < LANES; l++) {
+          sx[l] += p[l];
+        }
+        if (k <= degree_) {
+          double *sxy = &xy_[k * LANES];
+          for (size_t l = 0; l < LANES; l++) {
+            sxy[l] += p[l] * yl[l];
+          }
+        }
+        for (size_t l = 0; l < LANES; l++) {
+          p[l] *= t[l];
+        }
+      }
+    }
+    // Remainder into lane 0
+    for (; i < size; i++) {
+      double p = 1.0, t = x[i] - shift;
+      yy_[0] += y[i] * y[i];
+      for (size_t k = 0; k < powers; k++) {
+        x_[k * LANES] += p;
+        if (k <= degree_) {
+          xy_[k * LANES] += p * y[i];
+        }
+        p *= t;
+      }
+    }
+    n_ += size;
+  }
+
+  // rebase
+  // Add lane sums of (x - from)ᵏ, k < count, to lane sums of (x - to)ᵏ,
+  // expanding (x - to)ᵏ = ((x - from) + d)ᵏ binomially, d = from - to
+  static void rebase(const vector<double> &from, size_t count, double d, vector<double> *to)
+  {
+    const size_t LANES = PowerSums::LANES;
+    vector<double> binomial(count, 0.0), powers(count, 1.0);
+    for (size_t k = 1; k < count; k++) {
+      powers[k] = powers[k - 1] * d;
+    }
+    binomial[0] = 1.0;
+    for (size_t k = 0; k < count; k++) {
+      // binomial holds row k of Pascal's triangle
+      for (size_t j = k; j > 0; j--) {
+        binomial[j] += binomial[j - 1];
+      }
+      for (size_t j = 0; j <= k; j++) {
+        double scale = binomial[j] * powers[k - j];
+        for (size_t l = 0; l < LANES; l++) {
+          (*to)[k * LANES + l] += scale * from[j * LANES + l];
+        }
+      }
+    }
+  }
+
+  void PowerSums::merge(const PowerSums &other)
+  {
+    if (!other.n_) {
+      return;
+    }
+    if (!n_) {
+      shift_ = other.shift_;
+      shifted_ = true;
+    }
+    if (other.shift_ != shift_) {
+      double d = other.shift_ - shift_;
+      rebase(other.x_, 2 * degree_ + 1, d, &x_);
+      rebase(other.xy_, degree_ + 1, d, &xy_);
+    } else {
+      for (size_t i = 0; i < x_.size(); i++) {
+        x_[i] += other.x_[i];
+      }
+      for (size_t i = 0; i < xy_.size(); i++) {
+        xy_[i] += other.xy_[i];
+      }
+    }
+    for (size_t i = 0; i < yy_.size(); i++) {
+      yy_[i] += other.yy_[i];
+    }
+    n_ += other.n_;
+  }
+
+  void PowerSums::clear()
+  {
+    std::fill(x_.begin(), x_.end(), 0.0);
+    std::fill(xy_.begin(), xy_.end(), 0.0);
+    std::fill(yy_.begin(), yy_.end(), 0.0);
+    n_ = 0;
+    shift_ = 0.0;
+    shifted_ = false;
+  }
+
+  double PowerSums::lanes(const vector<double> &sums, size_t k) const
+  {
+    double total = 0.0;
+    for (size_t l = 0; l < LANES; l++) {
+      total += sums[k * LANES + l];
+    }
+    return total;
+  }
+
+  double PowerSums::x(size_t k) const { return lanes(x_, k); }
+  double PowerSums::xy(size_t k) const { return lanes(xy_, k); }
+  double PowerSums::yy() const { return lanes(yy_, 0); }
+
+  // NormalEquations
+  // The Gram matrix of [1, t, … tᴷ, y] is a Hankel matrix of the power
+  // sums bordered by Σtᵏy and Σy².  The powers are already about the
+  // sums' shift, so the predictors themselves are taken about 0.
+  NormalEquations::NormalEquations(const PowerSums &sums) :
+    p_(sums.degree()), n_(sums.size()), shift_(p_), shifted_(true),
+    gram_((p_ + 2) * (p_ + 2)), block_(BLOCK_ROWS * (p_ + 2)), pending_(0)
+  {
+    size_t d = p_ + 2;
+    for (size_t i = 0; i <= p_; i++) {
+      for (size_t j = i; j <= p_; j++) {
+        gram_[i * d + j] = sums.x(i + j);
+      }
+      gram_[i * d + d - 1] = sums.xy(i);
+    }
+    gram_[d * d - 1] = sums.yy();
+  }
+
+  // getPowerSums
+  // A first pass finds the mean x, the best shift for the powers
+  void getPowerSums(const DataSet &data, PowerSums *sums)
+  {
+    STATS_TIMER(STATS_SUMS);
+    size_t n = data.size();
+    if (n && !sums->size()) {
+      double total = 0.0;
+      for (size_t i = 0; i < n; i++) {
+        total += data.x()[i];
+      }
+      sums->setShift(total / n);
+    }
+    sums->add(data.x(), data.y(), n);
+  }
+
+  // PowerCollector
+  // Scanner sink pairing numbers into a block for PowerSums::add.
+  struct PowerCollector {
+    static const size_t BLOCK = 1024;
+
+    PowerCollector(PowerSums *sums) : sums(sums), size(0), xy(false) {}
+    void operator()(double d)
+    {
+      if (xy) {
+        y[size++] = d;
+        if (BLOCK == size) {
+          flush();
+        }
+      } else {
+        x[size] = d;
+      }
+      xy ^= true; // Toggle x/y
+    }
+    void flush()
+    {
+      sums->add(x, y, size);
+      size = 0;
+    }
+    PowerSums *sums;
+    double x[BLOCK];
+    double y[BLOCK];
+    size_t size;
+    bool xy;
+  };
+
+  bool streamPowerSums(const char *file, PowerSums *sums)
+  {
+    PowerCollector collector(sums);
+    if (!scanFile(file, collector)) {
+      return false;
+    }
+    collector.flush();
+    return true;
+  }
+
+  // fitPolynomial
+  // Solve for y = Σ dⱼ tʲ in t = x - s, then expand each (x - s)ʲ to
+  // give cₖ = Σⱼ≥ₖ dⱼ C(j, k) (-s)ʲ⁻ᵏ.
+  bool fitPolynomial(const PowerSums &sums, vector<double> *coefficients)
+  {
+    vector<double> d;
+    if (!NormalEquations(sums).solve(&d)) {
+      return false;
+    }
+    size_t terms = d.size();
+    double s = -sums.shift();
+    coefficients->assign(terms, 0.0);
+    // row[k] is C(j, k) (-s)ʲ⁻ᵏ
+    vector<double> row(terms, 0.0);
+    for (size_t j = 0; j < terms; j++) {
+      for (size_t k = j; k > 0; k--) {
+        row[k] = row[k - 1] + row[k] * s;
+      }
+      row[0] = j ? row[0] * s : 1.0;
+      for (size_t k = 0; k <= j; k++) {
+        (*coefficients)[k] += d[j] * row[k];
+      }
+    }
+    return true;
+  }
+} // namespace hedger
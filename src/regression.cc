@@ -18,32 +18,779 @@
 // Copyright (C) 2020 Greg Hedger
 //
 
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
-#include <vector>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "regression.h"
 
 using namespace std;
 
 namespace hedger {
-  struct DataPoint {
-    double x;
-    double y;
+  // Sums kernels
+  // Each kernel reads size {x,y} points, interleaved or as separate
+  // columns, and writes Σx, Σy, Σx², Σxy and Σy² to out[0..4].  Locals hold the
+  // running sums so nothing escapes through the output pointers inside
+  // the loop.
+  template <typename T, typename A>
+  struct SumsKernels {
+    void (*points)(const BasicDataPoint<T> *data, size_t size, A *out);
+    void (*columns)(const T *xs, const T *ys, size_t size, A *out);
   };
 
-  void printUsage() {
-    printf("regression\n");
-    printf("Ordinary Least Squares (OLS) linear regression analysis.\n");
-    printf("Calculates Y baseline b and slope m from set of {x,y} points.\n");
-    printf("Copyright (C) 2020 Greg Hedger\n");
-    printf("\nOptions:\n");
-    printf("  -f Specify CSV or other non-digit-separated file\n");
-    printf("  -xf Specify file and swap x and y values\n");
-    printf("\nUsage:\n");
-    printf(" regression [x₁] [y₁] ... [xₙ] [yₙ]\n");
-    printf(" regression -f [csv_file]\n");
-    printf(" regression -xf [csv_file]\n");
-    printf("CSV files can use any non-digit separator.");
+  // Portable kernels for any data and accumulator type; four independent
+  // accumulators per sum.  Also used for the tails of the vector kernels.
+  template <typename T, typename A>
+  static void getSumsGeneric(const BasicDataPoint<T> *data, size_t size, A *out)
+  {
+    const int LANES = 4;
+    A x[LANES] = {}, y[LANES] = {}, xSquared[LANES] = {}, xy[LANES] = {};
+    A ySquared[LANES] = {};
+    size_t i = 0;
+    for (; i + LANES <= size; i += LANES) {
+      for (int k = 0; k < LANES; k++) {
+        A px = data[i + k].x, py = data[i + k].y;
+        x[k] += px;
+        y[k] += py;
+        xSquared[k] += px * px;
+        xy[k] += px * py;
+        ySquared[k] += py * py;
+      }
+    }
+    for (; i < size; i++) {
+      A px = data[i].x, py = data[i].y;
+      x[0] += px;
+      y[0] += py;
+      xSquared[0] += px * px;
+      xy[0] += px * py;
+      ySquared[0] += py * py;
+    }
+    out[0] = (x[0] + x[1]) + (x[2] + x[3]);
+    out[1] = (y[0] + y[1]) + (y[2] + y[3]);
+    out[2] = (xSquared[0] + xSquared[1]) + (xSquared[2] + xSquared[3]);
+    out[3] = (xy[0] + xy[1]) + (xy[2] + xy[3]);
+    out[4] = (ySquared[0] + ySquared[1]) + (ySquared[2] + ySquared[3]);
+  }
+
+  template <typename T, typename A>
+  static void getSumsColumnsGeneric(const T *xs, const T *ys, size_t size, A *out)
+  {
+    const int LANES = 4;
+    A x[LANES] = {}, y[LANES] = {}, xSquared[LANES] = {}, xy[LANES] = {};
+    A ySquared[LANES] = {};
+    size_t i = 0;
+    for (; i + LANES <= size; i += LANES) {
+      for (int k = 0; k < LANES; k++) {
+        A px = xs[i + k], py = ys[i + k];
+        x[k] += px;
+        y[k] += py;
+        xSquared[k] += px * px;
+        xy[k] += px * py;
+        ySquared[k] += py * py;
+      }
+    }
+    for (; i < size; i++) {
+      A px = xs[i], py = ys[i];
+      x[0] += px;
+      y[0] += py;
+      xSquared[0] += px * px;
+      xy[0] += px * py;
+      ySquared[0] += py * py;
+    }
+    out[0] = (x[0] + x[1]) + (x[2] + x[3]);
+    out[1] = (y[0] + y[1]) + (y[2] + y[3]);
+    out[2] = (xSquared[0] + xSquared[1]) + (xSquared[2] + xSquared[3]);
+    out[3] = (xy[0] + xy[1]) + (xy[2] + xy[3]);
+    out[4] = (ySquared[0] + ySquared[1]) + (ySquared[2] + ySquared[3]);
+  }
+
+  static void getSumsScalar(const DataPoint *data, size_t size, double *out)
+  {
+    double x = 0.0, y = 0.0, xSquared = 0.0, xy = 0.0, ySquared = 0.0;
+    for( size_t i = 0; i < size; i++ ) {
+      x += data[i].x;
+      y += data[i].y;
+      xSquared += data[i].x * data[i].x;
+      xy += data[i].x * data[i].y;
+      ySquared += data[i].y * data[i].y;
+    }
+    out[0] = x;
+    out[1] = y;
+    out[2] = xSquared;
+    out[3] = xy;
+    out[4] = ySquared;
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  // With points interleaved, a vector of {x₀ y₀ x₁ y₁} summed lane-wise
+  // collects Σx and Σy in alternate lanes, and multiplying it by its
+  // duplicated even lanes {x₀ x₀ x₁ x₁} gives {x₀² x₀y₀ x₁² x₁y₁}, which
+  // collects Σx² and Σxy the same way.  The vector squared collects Σy²
+  // in its odd lanes.  Four independent accumulators of each hide the add
+  // latency.
+  __attribute__((target("avx2,fma")))
+  static void getSumsAvx2(const DataPoint *data, size_t size, double *out)
+  {
+    const double *p = &data[0].x;
+    __m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    __m256d q0 = s0, q1 = s0, q2 = s0, q3 = s0;
+    __m256d r0 = s0, r1 = s0, r2 = s0, r3 = s0;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+      __m256d v0 = _mm256_loadu_pd(p + 2 * i);
+      __m256d v1 = _mm256_loadu_pd(p + 2 * i + 4);
+      __m256d v2 = _mm256_loadu_pd(p + 2 * i + 8);
+      __m256d v3 = _mm256_loadu_pd(p + 2 * i + 12);
+      s0 = _mm256_add_pd(s0, v0);
+      s1 = _mm256_add_pd(s1, v1);
+      s2 = _mm256_add_pd(s2, v2);
+      s3 = _mm256_add_pd(s3, v3);
+      q0 = _mm256_fmadd_pd(_mm256_movedup_pd(v0), v0, q0);
+      q1 = _mm256_fmadd_pd(_mm256_movedup_pd(v1), v1, q1);
+      q2 = _mm256_fmadd_pd(_mm256_movedup_pd(v2), v2, q2);
+      q3 = _mm256_fmadd_pd(_mm256_movedup_pd(v3), v3, q3);
+      r0 = _mm256_fmadd_pd(v0, v0, r0);
+      r1 = _mm256_fmadd_pd(v1, v1, r1);
+      r2 = _mm256_fmadd_pd(v2, v2, r2);
+      r3 = _mm256_fmadd_pd(v3, v3, r3);
+    }
+    for (; i + 2 <= size; i += 2) {
+      __m256d v0 = _mm256_loadu_pd(p + 2 * i);
+      s0 = _mm256_add_pd(s0, v0);
+      q0 = _mm256_fmadd_pd(_mm256_movedup_pd(v0), v0, q0);
+      r0 = _mm256_fmadd_pd(v0, v0, r0);
+    }
+    s0 = _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3));
+    q0 = _mm256_add_pd(_mm256_add_pd(q0, q1), _mm256_add_pd(q2, q3));
+    r0 = _mm256_add_pd(_mm256_add_pd(r0, r1), _mm256_add_pd(r2, r3));
+    double s[4], q[4], r[4];
+    _mm256_storeu_pd(s, s0);
+    _mm256_storeu_pd(q, q0);
+    _mm256_storeu_pd(r, r0);
+    double tail[5];
+    getSumsScalar(data + i, size - i, tail);
+    out[0] = (s[0] + s[2]) + tail[0];
+    out[1] = (s[1] + s[3]) + tail[1];
+    out[2] = (q[0] + q[2]) + tail[2];
+    out[3] = (q[1] + q[3]) + tail[3];
+    out[4] = (r[1] + r[3]) + tail[4];
+  }
+
+  // GCC flags the deliberately undefined lanes inside the AVX-512
+  // intrinsics at -O3; they are never read
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+  __attribute__((target("avx512f")))
+  static void getSumsAvx512(const DataPoint *data, size_t size, double *out)
+  {
+    const double *p = &data[0].x;
+    __m512d s0 = _mm512_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    __m512d q0 = s0, q1 = s0, q2 = s0, q3 = s0;
+    __m512d r0 = s0, r1 = s0, r2 = s0, r3 = s0;
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+      __m512d v0 = _mm512_loadu_pd(p + 2 * i);
+      __m512d v1 = _mm512_loadu_pd(p + 2 * i + 8);
+      __m512d v2 = _mm512_loadu_pd(p + 2 * i + 16);
+      __m512d v3 = _mm512_loadu_pd(p + 2 * i + 24);
+      s0 = _mm512_add_pd(s0, v0);
+      s1 = _mm512_add_pd(s1, v1);
+      s2 = _mm512_add_pd(s2, v2);
+      s3 = _mm512_add_pd(s3, v3);
+      q0 = _mm512_fmadd_pd(_mm512_movedup_pd(v0), v0, q0);
+      q1 = _mm512_fmadd_pd(_mm512_movedup_pd(v1), v1, q1);
+      q2 = _mm512_fmadd_pd(_mm512_movedup_pd(v2), v2, q2);
+      q3 = _mm512_fmadd_pd(_mm512_movedup_pd(v3), v3, q3);
+      r0 = _mm512_fmadd_pd(v0, v0, r0);
+      r1 = _mm512_fmadd_pd(v1, v1, r1);
+      r2 = _mm512_fmadd_pd(v2, v2, r2);
+      r3 = _mm512_fmadd_pd(v3, v3, r3);
+    }
+    for (; i + 4 <= size; i += 4) {
+      __m512d v0 = _mm512_loadu_pd(p + 2 * i);
+      s0 = _mm512_add_pd(s0, v0);
+      q0 = _mm512_fmadd_pd(_mm512_movedup_pd(v0), v0, q0);
+      r0 = _mm512_fmadd_pd(v0, v0, r0);
+    }
+    s0 = _mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3));
+    q0 = _mm512_add_pd(_mm512_add_pd(q0, q1), _mm512_add_pd(q2, q3));
+    r0 = _mm512_add_pd(_mm512_add_pd(r0, r1), _mm512_add_pd(r2, r3));
+    double s[8], q[8], r[8];
+    _mm512_storeu_pd(s, s0);
+    _mm512_storeu_pd(q, q0);
+    _mm512_storeu_pd(r, r0);
+    double tail[5];
+    getSumsScalar(data + i, size - i, tail);
+    out[0] = ((s[0] + s[2]) + (s[4] + s[6])) + tail[0];
+    out[1] = ((s[1] + s[3]) + (s[5] + s[7])) + tail[1];
+    out[2] = ((q[0] + q[2]) + (q[4] + q[6])) + tail[2];
+    out[3] = ((q[1] + q[3]) + (q[5] + q[7])) + tail[3];
+    out[4] = ((r[1] + r[3]) + (r[5] + r[7])) + tail[4];
+  }
+#pragma GCC diagnostic pop
+#endif
+
+#if defined(__aarch64__)
+  // NEON is always present on AArch64.  A vector holds a whole {x,y}
+  // point; lane-wise sums give {Σx Σy}, multiplying by the broadcast
+  // x gives {x² xy} and by the broadcast y gives {xy y²}.
+  static void getSumsNeon(const DataPoint *data, size_t size, double *out)
+  {
+    const double *p = &data[0].x;
+    float64x2_t s0 = vdupq_n_f64(0.0), s1 = s0, s2 = s0, s3 = s0;
+    float64x2_t q0 = s0, q1 = s0, q2 = s0, q3 = s0;
+    float64x2_t r0 = s0, r1 = s0, r2 = s0, r3 = s0;
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+      float64x2_t v0 = vld1q_f64(p + 2 * i);
+      float64x2_t v1 = vld1q_f64(p + 2 * i + 2);
+      float64x2_t v2 = vld1q_f64(p + 2 * i + 4);
+      float64x2_t v3 = vld1q_f64(p + 2 * i + 6);
+      s0 = vaddq_f64(s0, v0);
+      s1 = vaddq_f64(s1, v1);
+      s2 = vaddq_f64(s2, v2);
+      s3 = vaddq_f64(s3, v3);
+      q0 = vfmaq_laneq_f64(q0, v0, v0, 0);
+      q1 = vfmaq_laneq_f64(q1, v1, v1, 0);
+      q2 = vfmaq_laneq_f64(q2, v2, v2, 0);
+      q3 = vfmaq_laneq_f64(q3, v3, v3, 0);
+      r0 = vfmaq_laneq_f64(r0, v0, v0, 1);
+      r1 = vfmaq_laneq_f64(r1, v1, v1, 1);
+      r2 = vfmaq_laneq_f64(r2, v2, v2, 1);
+      r3 = vfmaq_laneq_f64(r3, v3, v3, 1);
+    }
+    s0 = vaddq_f64(vaddq_f64(s0, s1), vaddq_f64(s2, s3));
+    q0 = vaddq_f64(vaddq_f64(q0, q1), vaddq_f64(q2, q3));
+    r0 = vaddq_f64(vaddq_f64(r0, r1), vaddq_f64(r2, r3));
+    double tail[5];
+    getSumsScalar(data + i, size - i, tail);
+    out[0] = vgetq_lane_f64(s0, 0) + tail[0];
+    out[1] = vgetq_lane_f64(s0, 1) + tail[1];
+    out[2] = vgetq_lane_f64(q0, 0) + tail[2];
+    out[3] = vgetq_lane_f64(q0, 1) + tail[3];
+    out[4] = vgetq_lane_f64(r0, 1) + tail[4];
+  }
+#endif
+
+  // Columnar sums kernels
+  // Same results as the point kernels, from separate x and y arrays.
+  static void getSumsColumnsScalar(const double *xs, const double *ys, size_t size, double *out)
+  {
+    double x = 0.0, y = 0.0, xSquared = 0.0, xy = 0.0, ySquared = 0.0;
+    for( size_t i = 0; i < size; i++ ) {
+      x += xs[i];
+      y += ys[i];
+      xSquared += xs[i] * xs[i];
+      xy += xs[i] * ys[i];
+      ySquared += ys[i] * ys[i];
+    }
+    out[0] = x;
+    out[1] = y;
+    out[2] = xSquared;
+    out[3] = xy;
+    out[4] = ySquared;
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  __attribute__((target("avx2,fma")))
+  static double sumLanes(__m256d v)
+  {
+    double l[4];
+    _mm256_storeu_pd(l, v);
+    return (l[0] + l[1]) + (l[2] + l[3]);
+  }
+
+  // Two independent accumulators per sum, eight points per iteration
+  __attribute__((target("avx2,fma")))
+  static void getSumsColumnsAvx2(const double *xs, const double *ys, size_t size, double *out)
+  {
+    __m256d sx0 = _mm256_setzero_pd(), sx1 = sx0, sy0 = sx0, sy1 = sx0;
+    __m256d sxx0 = sx0, sxx1 = sx0, sxy0 = sx0, sxy1 = sx0;
+    __m256d syy0 = sx0, syy1 = sx0;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+      __m256d x0 = _mm256_loadu_pd(xs + i), x1 = _mm256_loadu_pd(xs + i + 4);
+      __m256d y0 = _mm256_loadu_pd(ys + i), y1 = _mm256_loadu_pd(ys + i + 4);
+      sx0 = _mm256_add_pd(sx0, x0);
+      sx1 = _mm256_add_pd(sx1, x1);
+      sy0 = _mm256_add_pd(sy0, y0);
+      sy1 = _mm256_add_pd(sy1, y1);
+      sxx0 = _mm256_fmadd_pd(x0, x0, sxx0);
+      sxx1 = _mm256_fmadd_pd(x1, x1, sxx1);
+      sxy0 = _mm256_fmadd_pd(x0, y0, sxy0);
+      sxy1 = _mm256_fmadd_pd(x1, y1, sxy1);
+      syy0 = _mm256_fmadd_pd(y0, y0, syy0);
+      syy1 = _mm256_fmadd_pd(y1, y1, syy1);
+    }
+    double tail[5];
+    getSumsColumnsScalar(xs + i, ys + i, size - i, tail);
+    out[0] = sumLanes(_mm256_add_pd(sx0, sx1)) + tail[0];
+    out[1] = sumLanes(_mm256_add_pd(sy0, sy1)) + tail[1];
+    out[2] = sumLanes(_mm256_add_pd(sxx0, sxx1)) + tail[2];
+    out[3] = sumLanes(_mm256_add_pd(sxy0, sxy1)) + tail[3];
+    out[4] = sumLanes(_mm256_add_pd(syy0, syy1)) + tail[4];
+  }
+
+  // Two independent accumulators per sum, sixteen points per iteration
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+  __attribute__((target("avx512f")))
+  static void getSumsColumnsAvx512(const double *xs, const double *ys, size_t size, double *out)
+  {
+    __m512d sx0 = _mm512_setzero_pd(), sx1 = sx0, sy0 = sx0, sy1 = sx0;
+    __m512d sxx0 = sx0, sxx1 = sx0, sxy0 = sx0, sxy1 = sx0;
+    __m512d syy0 = sx0, syy1 = sx0;
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+      __m512d x0 = _mm512_loadu_pd(xs + i), x1 = _mm512_loadu_pd(xs + i + 8);
+      __m512d y0 = _mm512_loadu_pd(ys + i), y1 = _mm512_loadu_pd(ys + i + 8);
+      sx0 = _mm512_add_pd(sx0, x0);
+      sx1 = _mm512_add_pd(sx1, x1);
+      sy0 = _mm512_add_pd(sy0, y0);
+      sy1 = _mm512_add_pd(sy1, y1);
+      sxx0 = _mm512_fmadd_pd(x0, x0, sxx0);
+      sxx1 = _mm512_fmadd_pd(x1, x1, sxx1);
+      sxy0 = _mm512_fmadd_pd(x0, y0, sxy0);
+      sxy1 = _mm512_fmadd_pd(x1, y1, sxy1);
+      syy0 = _mm512_fmadd_pd(y0, y0, syy0);
+      syy1 = _mm512_fmadd_pd(y1, y1, syy1);
+    }
+    double tail[5];
+    getSumsColumnsScalar(xs + i, ys + i, size - i, tail);
+    out[0] = _mm512_reduce_add_pd(_mm512_add_pd(sx0, sx1)) + tail[0];
+    out[1] = _mm512_reduce_add_pd(_mm512_add_pd(sy0, sy1)) + tail[1];
+    out[2] = _mm512_reduce_add_pd(_mm512_add_pd(sxx0, sxx1)) + tail[2];
+    out[3] = _mm512_reduce_add_pd(_mm512_add_pd(sxy0, sxy1)) + tail[3];
+    out[4] = _mm512_reduce_add_pd(_mm512_add_pd(syy0, syy1)) + tail[4];
+  }
+#pragma GCC diagnostic pop
+#endif
+
+#if defined(__aarch64__)
+  static void getSumsColumnsNeon(const double *xs, const double *ys, size_t size, double *out)
+  {
+    float64x2_t sx0 = vdupq_n_f64(0.0), sx1 = sx0, sy0 = sx0, sy1 = sx0;
+    float64x2_t sxx0 = sx0, sxx1 = sx0, sxy0 = sx0, sxy1 = sx0;
+    float64x2_t syy0 = sx0, syy1 = sx0;
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+      float64x2_t x0 = vld1q_f64(xs + i), x1 = vld1q_f64(xs + i + 2);
+      float64x2_t y0 = vld1q_f64(ys + i), y1 = vld1q_f64(ys + i + 2);
+      sx0 = vaddq_f64(sx0, x0);
+      sx1 = vaddq_f64(sx1, x1);
+      sy0 = vaddq_f64(sy0, y0);
+      sy1 = vaddq_f64(sy1, y1);
+      sxx0 = vfmaq_f64(sxx0, x0, x0);
+      sxx1 = vfmaq_f64(sxx1, x1, x1);
+      sxy0 = vfmaq_f64(sxy0, x0, y0);
+      sxy1 = vfmaq_f64(sxy1, x1, y1);
+      syy0 = vfmaq_f64(syy0, y0, y0);
+      syy1 = vfmaq_f64(syy1, y1, y1);
+    }
+    double tail[5];
+    getSumsColumnsScalar(xs + i, ys + i, size - i, tail);
+    out[0] = vaddvq_f64(vaddq_f64(sx0, sx1)) + tail[0];
+    out[1] = vaddvq_f64(vaddq_f64(sy0, sy1)) + tail[1];
+    out[2] = vaddvq_f64(vaddq_f64(sxx0, sxx1)) + tail[2];
+    out[3] = vaddvq_f64(vaddq_f64(sxy0, sxy1)) + tail[3];
+    out[4] = vaddvq_f64(vaddq_f64(syy0, syy1)) + tail[4];
+  }
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+  // Single precision kernels.  Summed in float, a vector holds twice as
+  // many points as in double; summed in double, each half register of
+  // floats is widened on load and then handled like double data.
+  __attribute__((target("avx2,fma")))
+  static float sumLanes(__m256 v)
+  {
+    float l[8];
+    _mm256_storeu_ps(l, v);
+    return ((l[0] + l[1]) + (l[2] + l[3])) + ((l[4] + l[5]) + (l[6] + l[7]));
+  }
+
+  __attribute__((target("avx2,fma")))
+  static void getSumsF32Avx2(const BasicDataPoint<float> *data, size_t size, float *out)
+  {
+    const float *p = &data[0].x;
+    __m256 s0 = _mm256_setzero_ps(), s1 = s0, q0 = s0, q1 = s0, r0 = s0, r1 = s0;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+      __m256 v0 = _mm256_loadu_ps(p + 2 * i);
+      __m256 v1 = _mm256_loadu_ps(p + 2 * i + 8);
+      s0 = _mm256_add_ps(s0, v0);
+      s1 = _mm256_add_ps(s1, v1);
+      q0 = _mm256_fmadd_ps(_mm256_moveldup_ps(v0), v0, q0);
+      q1 = _mm256_fmadd_ps(_mm256_moveldup_ps(v1), v1, q1);
+      r0 = _mm256_fmadd_ps(v0, v0, r0);
+      r1 = _mm256_fmadd_ps(v1, v1, r1);
+    }
+    s0 = _mm256_add_ps(s0, s1);
+    q0 = _mm256_add_ps(q0, q1);
+    r0 = _mm256_add_ps(r0, r1);
+    float s[8], q[8], r[8];
+    _mm256_storeu_ps(s, s0);
+    _mm256_storeu_ps(q, q0);
+    _mm256_storeu_ps(r, r0);
+    float tail[5];
+    getSumsGeneric(data + i, size - i, tail);
+    out[0] = ((s[0] + s[2]) + (s[4] + s[6])) + tail[0];
+    out[1] = ((s[1] + s[3]) + (s[5] + s[7])) + tail[1];
+    out[2] = ((q[0] + q[2]) + (q[4] + q[6])) + tail[2];
+    out[3] = ((q[1] + q[3]) + (q[5] + q[7])) + tail[3];
+    out[4] = ((r[1] + r[3]) + (r[5] + r[7])) + tail[4];
+  }
+
+  __attribute__((target("avx2,fma")))
+  static void getSumsF32F64Avx2(const BasicDataPoint<float> *data, size_t size, double *out)
+  {
+    const float *p = &data[0].x;
+    __m256d s0 = _mm256_setzero_pd(), s1 = s0, q0 = s0, q1 = s0, r0 = s0, r1 = s0;
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+      __m256d v0 = _mm256_cvtps_pd(_mm_loadu_ps(p + 2 * i));
+      __m256d v1 = _mm256_cvtps_pd(_mm_loadu_ps(p + 2 * i + 4));
+      s0 = _mm256_add_pd(s0, v0);
+      s1 = _mm256_add_pd(s1, v1);
+      q0 = _mm256_fmadd_pd(_mm256_movedup_pd(v0), v0, q0);
+      q1 = _mm256_fmadd_pd(_mm256_movedup_pd(v1), v1, q1);
+      r0 = _mm256_fmadd_pd(v0, v0, r0);
+      r1 = _mm256_fmadd_pd(v1, v1, r1);
+    }
+    s0 = _mm256_add_pd(s0, s1);
+    q0 = _mm256_add_pd(q0, q1);
+    r0 = _mm256_add_pd(r0, r1);
+    double s[4], q[4], r[4];
+    _mm256_storeu_pd(s, s0);
+    _mm256_storeu_pd(q, q0);
+    _mm256_storeu_pd(r, r0);
+    double tail[5];
+    getSumsGeneric(data + i, size - i, tail);
+    out[0] = (s[0] + s[2]) + tail[0];
+    out[1] = (s[1] + s[3]) + tail[1];
+    out[2] = (q[0] + q[2]) + tail[2];
+    out[3] = (q[1] + q[3]) + tail[3];
+    out[4] = (r[1] + r[3]) + tail[4];
+  }
+
+  __attribute__((target("avx2,fma")))
+  static void getSumsColumnsF32Avx2(const float *xs, const float *ys, size_t size, float *out)
+  {
+    __m256 sx0 = _mm256_setzero_ps(), sx1 = sx0, sy0 = sx0, sy1 = sx0;
+    __m256 sxx0 = sx0, sxx1 = sx0, sxy0 = sx0, sxy1 = sx0;
+    __m256 syy0 = sx0, syy1 = sx0;
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+      __m256 x0 = _mm256_loadu_ps(xs + i), x1 = _mm256_loadu_ps(xs + i + 8);
+      __m256 y0 = _mm256_loadu_ps(ys + i), y1 = _mm256_loadu_ps(ys + i + 8);
+      sx0 = _mm256_add_ps(sx0, x0);
+      sx1 = _mm256_add_ps(sx1, x1);
+      sy0 = _mm256_add_ps(sy0, y0);
+      sy1 = _mm256_add_ps(sy1, y1);
+      sxx0 = _mm256_fmadd_ps(x0, x0, sxx0);
+      sxx1 = _mm256_fmadd_ps(x1, x1, sxx1);
+      sxy0 = _mm256_fmadd_ps(x0, y0, sxy0);
+      sxy1 = _mm256_fmadd_ps(x1, y1, sxy1);
+      syy0 = _mm256_fmadd_ps(y0, y0, syy0);
+      syy1 = _mm256_fmadd_ps(y1, y1, syy1);
+    }
+    float tail[5];
+    getSumsColumnsGeneric(xs + i, ys + i, size - i, tail);
+    out[0] = sumLanes(_mm256_add_ps(sx0, sx1)) + tail[0];
+    out[1] = sumLanes(_mm256_add_ps(sy0, sy1)) + tail[1];
+    out[2] = sumLanes(_mm256_add_ps(sxx0, sxx1)) + tail[2];
+    out[3] = sumLanes(_mm256_add_ps(sxy0, sxy1)) + tail[3];
+    out[4] = sumLanes(_mm256_add_ps(syy0, syy1)) + tail[4];
+  }
+
+  __attribute__((target("avx2,fma")))
+  static void getSumsColumnsF32F64Avx2(const float *xs, const float *ys, size_t size, double *out)
+  {
+    __m256d sx0 = _mm256_setzero_pd(), sx1 = sx0, sy0 = sx0, sy1 = sx0;
+    __m256d sxx0 = sx0, sxx1 = sx0, sxy0 = sx0, sxy1 = sx0;
+    __m256d syy0 = sx0, syy1 = sx0;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+      __m256d x0 = _mm256_cvtps_pd(_mm_loadu_ps(xs + i));
+      __m256d x1 = _mm256_cvtps_pd(_mm_loadu_ps(xs + i + 4));
+      __m256d y0 = _mm256_cvtps_pd(_mm_loadu_ps(ys + i));
+      __m256d y1 = _mm256_cvtps_pd(_mm_loadu_ps(ys + i + 4));
+      sx0 = _mm256_add_pd(sx0, x0);
+      sx1 = _mm256_add_pd(sx1, x1);
+      sy0 = _mm256_add_pd(sy0, y0);
+      sy1 = _mm256_add_pd(sy1, y1);
+      sxx0 = _mm256_fmadd_pd(x0, x0, sxx0);
+      sxx1 = _mm256_fmadd_pd(x1, x1, sxx1);
+      sxy0 = _mm256_fmadd_pd(x0, y0, sxy0);
+      sxy1 = _mm256_fmadd_pd(x1, y1, sxy1);
+      syy0 = _mm256_fmadd_pd(y0, y0, syy0);
+      syy1 = _mm256_fmadd_pd(y1, y1, syy1);
+    }
+    double tail[5];
+    getSumsColumnsGeneric(xs + i, ys + i, size - i, tail);
+    out[0] = sumLanes(_mm256_add_pd(sx0, sx1)) + tail[0];
+    out[1] = sumLanes(_mm256_add_pd(sy0, sy1)) + tail[1];
+    out[2] = sumLanes(_mm256_add_pd(sxx0, sxx1)) + tail[2];
+    out[3] = sumLanes(_mm256_add_pd(sxy0, sxy1)) + tail[3];
+    out[4] = sumLanes(_mm256_add_pd(syy0, syy1)) + tail[4];
+  }
+
+  static bool hasAvx2()
+  {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  }
+#endif
+
+  // selectSumsKernels
+  // Pick the widest sums kernels the running CPU supports for a data and
+  // accumulator type.  Combinations without vector kernels use the
+  // portable ones.
+  template <typename T, typename A>
+  static SumsKernels<T, A> selectSumsKernels()
+  {
+    SumsKernels<T, A> k = { getSumsGeneric<T, A>, getSumsColumnsGeneric<T, A> };
+    return k;
+  }
+
+  template <>
+  SumsKernels<double, double> selectSumsKernels<double, double>()
+  {
+    SumsKernels<double, double> k = { getSumsScalar, getSumsColumnsScalar };
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+      k.points = getSumsAvx512;
+      k.columns = getSumsColumnsAvx512;
+    } else if (hasAvx2()) {
+      k.points = getSumsAvx2;
+      k.columns = getSumsColumnsAvx2;
+    }
+#elif defined(__aarch64__)
+    k.points = getSumsNeon;
+    k.columns = getSumsColumnsNeon;
+#endif
+    return k;
+  }
+
+  template <>
+  SumsKernels<float, float> selectSumsKernels<float, float>()
+  {
+    SumsKernels<float, float> k = { getSumsGeneric<float, float>, getSumsColumnsGeneric<float, float> };
+#if defined(__x86_64__) || defined(__i386__)
+    if (hasAvx2()) {
+      k.points = getSumsF32Avx2;
+      k.columns = getSumsColumnsF32Avx2;
+    }
+#endif
+    return k;
+  }
+
+  template <>
+  SumsKernels<float, double> selectSumsKernels<float, double>()
+  {
+    SumsKernels<float, double> k = { getSumsGeneric<float, double>, getSumsColumnsGeneric<float, double> };
+#if defined(__x86_64__) || defined(__i386__)
+    if (hasAvx2()) {
+      k.points = getSumsF32F64Avx2;
+      k.columns = getSumsColumnsF32F64Avx2;
+    }
+#endif
+    return k;
+  }
+
+  // sumsKernels
+  // The kernels in use for a data and accumulator type, chosen on first use.
+  template <typename T, typename A>
+  static const SumsKernels<T, A> &sumsKernels()
+  {
+    static const SumsKernels<T, A> k = selectSumsKernels<T, A>();
+    return k;
+  }
+
+  // Weighted sums kernels
+  // Each reads x, y and weight columns and writes Σw, Σwx, Σwy, Σwx², Σwxy
+  // and Σwy² to out[0..5].  wx and wy are formed once per point and feed
+  // two sums each.
+  typedef void (*WeightedSumsKernel)(const double *xs, const double *ys, const double *ws,
+      size_t size, double *out);
+
+  static void getWeightedSumsScalar(const double *xs, const double *ys, const double *ws,
+      size_t size, double *out)
+  {
+    double w = 0.0, x = 0.0, y = 0.0, xSquared = 0.0, xy = 0.0, ySquared = 0.0;
+    for( size_t i = 0; i < size; i++ ) {
+      double wx = ws[i] * xs[i], wy = ws[i] * ys[i];
+      w += ws[i];
+      x += wx;
+      y += wy;
+      xSquared += wx * xs[i];
+      xy += wx * ys[i];
+      ySquared += wy * ys[i];
+    }
+    out[0] = w;
+    out[1] = x;
+    out[2] = y;
+    out[3] = xSquared;
+    out[4] = xy;
+    out[5] = ySquared;
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  // Six accumulators are already six independent chains; a second set
+  // would spill with only sixteen registers
+  __attribute__((target("avx2,fma")))
+  static void getWeightedSumsAvx2(const double *xs, const double *ys, const double *ws,
+      size_t size, double *out)
+  {
+    __m256d sw = _mm256_setzero_pd(), sx = sw, sy = sw, sxx = sw, sxy = sw, syy = sw;
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+      __m256d x = _mm256_loadu_pd(xs + i);
+      __m256d y = _mm256_loadu_pd(ys + i);
+      __m256d w = _mm256_loadu_pd(ws + i);
+      __m256d wx = _mm256_mul_pd(w, x), wy = _mm256_mul_pd(w, y);
+      sw = _mm256_add_pd(sw, w);
+      sx = _mm256_add_pd(sx, wx);
+      sy = _mm256_add_pd(sy, wy);
+      sxx = _mm256_fmadd_pd(wx, x, sxx);
+      sxy = _mm256_fmadd_pd(wx, y, sxy);
+      syy = _mm256_fmadd_pd(wy, y, syy);
+    }
+    double tail[6];
+    getWeightedSumsScalar(xs + i, ys + i, ws + i, size - i, tail);
+    out[0] = sumLanes(sw) + tail[0];
+    out[1] = sumLanes(sx) + tail[1];
+    out[2] = sumLanes(sy) + tail[2];
+    out[3] = sumLanes(sxx) + tail[3];
+    out[4] = sumLanes(sxy) + tail[4];
+    out[5] = sumLanes(syy) + tail[5];
+  }
+
+  // Two sets of accumulators, sixteen points per iteration
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+  __attribute__((target("avx512f")))
+  static void getWeightedSumsAvx512(const double *xs, const double *ys, const double *ws,
+      size_t size, double *out)
+  {
+    __m512d sw0 = _mm512_setzero_pd(), sw1 = sw0, sx0 = sw0, sx1 = sw0, sy0 = sw0, sy1 = sw0;
+    __m512d sxx0 = sw0, sxx1 = sw0, sxy0 = sw0, sxy1 = sw0, syy0 = sw0, syy1 = sw0;
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+      __m512d x0 = _mm512_loadu_pd(xs + i), x1 = _mm512_loadu_pd(xs + i + 8);
+      __m512d y0 = _mm512_loadu_pd(ys + i), y1 = _mm512_loadu_pd(ys + i + 8);
+      __m512d w0 = _mm512_loadu_pd(ws + i), w1 = _mm512_loadu_pd(ws + i + 8);
+      __m512d wx0 = _mm512_mul_pd(w0, x0), wx1 = _mm512_mul_pd(w1, x1);
+      __m512d wy0 = _mm512_mul_pd(w0, y0), wy1 = _mm512_mul_pd(w1, y1);
+      sw0 = _mm512_add_pd(sw0, w0);
+      sw1 = _mm512_add_pd(sw1, w1);
+      sx0 = _mm512_add_pd(sx0, wx0);
+      sx1 = _mm512_add_pd(sx1, wx1);
+      sy0 = _mm512_add_pd(sy0, wy0);
+      sy1 = _mm512_add_pd(sy1, wy1);
+      sxx0 = _mm512_fmadd_pd(wx0, x0, sxx0);
+      sxx1 = _mm512_fmadd_pd(wx1, x1, sxx1);
+      sxy0 = _mm512_fmadd_pd(wx0, y0, sxy0);
+      sxy1 = _mm512_fmadd_pd(wx1, y1, sxy1);
+      syy0 = _mm512_fmadd_pd(wy0, y0, syy0);
+      syy1 = _mm512_fmadd_pd(wy1, y1, syy1);
+    }
+    double tail[6];
+    getWeightedSumsScalar(xs + i, ys + i, ws + i, size - i, tail);
+    out[0] = _mm512_reduce_add_pd(_mm512_add_pd(sw0, sw1)) + tail[0];
+    out[1] = _mm512_reduce_add_pd(_mm512_add_pd(sx0, sx1)) + tail[1];
+    out[2] = _mm512_reduce_add_pd(_mm512_add_pd(sy0, sy1)) + tail[2];
+    out[3] = _mm512_reduce_add_pd(_mm512_add_pd(sxx0, sxx1)) + tail[3];
+    out[4] = _mm512_reduce_add_pd(_mm512_add_pd(sxy0, sxy1)) + tail[4];
+    out[5] = _mm512_reduce_add_pd(_mm512_add_pd(syy0, syy1)) + tail[5];
+  }
+#pragma GCC diagnostic pop
+#endif
+
+#if defined(__aarch64__)
+  static void getWeightedSumsNeon(const double *xs, const double *ys, const double *ws,
+      size_t size, double *out)
+  {
+    float64x2_t sw0 = vdupq_n_f64(0.0), sw1 = sw0, sx0 = sw0, sx1 = sw0, sy0 = sw0, sy1 = sw0;
+    float64x2_t sxx0 = sw0, sxx1 = sw0, sxy0 = sw0, sxy1 = sw0, syy0 = sw0, syy1 = sw0;
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+      float64x2_t x0 = vld1q_f64(xs + i), x1 = vld1q_f64(xs + i + 2);
+      float64x2_t y0 = vld1q_f64(ys + i), y1 = vld1q_f64(ys + i + 2);
+      float64x2_t w0 = vld1q_f64(ws + i), w1 = vld1q_f64(ws + i + 2);
+      float64x2_t wx0 = vmulq_f64(w0, x0), wx1 = vmulq_f64(w1, x1);
+      float64x2_t wy0 = vmulq_f64(w0, y0), wy1 = vmulq_f64(w1, y1);
+      sw0 = vaddq_f64(sw0, w0);
+      sw1 = vaddq_f64(sw1, w1);
+      sx0 = vaddq_f64(sx0, wx0);
+      sx1 = vaddq_f64(sx1, wx1);
+      sy0 = vaddq_f64(sy0, wy0);
+      sy1 = vaddq_f64(sy1, wy1);
+      sxx0 = vfmaq_f64(sxx0, wx0, x0);
+      sxx1 = vfmaq_f64(sxx1, wx1, x1);
+      sxy0 = vfmaq_f64(sxy0, wx0, y0);
+      sxy1 = vfmaq_f64(sxy1, wx1, y1);
+      syy0 = vfmaq_f64(syy0, wy0, y0);
+      syy1 = vfmaq_f64(syy1, wy1, y1);
+    }
+    double tail[6];
+    getWeightedSumsScalar(xs + i, ys + i, ws + i, size - i, tail);
+    out[0] = vaddvq_f64(vaddq_f64(sw0, sw1)) + tail[0];
+    out[1] = vaddvq_f64(vaddq_f64(sx0, sx1)) + tail[1];
+    out[2] = vaddvq_f64(vaddq_f64(sy0, sy1)) + tail[2];
+    out[3] = vaddvq_f64(vaddq_f64(sxx0, sxx1)) + tail[3];
+    out[4] = vaddvq_f64(vaddq_f64(sxy0, sxy1)) + tail[4];
+    out[5] = vaddvq_f64(vaddq_f64(syy0, syy1)) + tail[5];
+  }
+#endif
+
+  static WeightedSumsKernel selectWeightedSumsKernel()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+      return getWeightedSumsAvx512;
+    }
+    if (hasAvx2()) {
+      return getWeightedSumsAvx2;
+    }
+#elif defined(__aarch64__)
+    return getWeightedSumsNeon;
+#endif
+    return getWeightedSumsScalar;
+  }
+
+  // getWeightedSums
+  // Get weighted sums for a weighted least squares fit
+  // Entry: x column
+  //        y column
+  //        weight column
+  //        # of points
+  //        pointer to destination sums
+  void getWeightedSums(const double *xs, const double *ys, const double *ws,
+      size_t size, WeightedSums *sums)
+  {
+    static const WeightedSumsKernel kernel = selectWeightedSumsKernel();
+    double out[6];
+    kernel(xs, ys, ws, size, out);
+    sums->n = size;
+    sums->w = out[0];
+    sums->x = out[1];
+    sums->y = out[2];
+    sums->xSquared = out[3];
+    sums->xy = out[4];
+    sums->ySquared = out[5];
   }
 
   // getSums
@@ -63,16 +810,74 @@ namespace hedger {
       double *xy
       )
   {
-    *x = 0.0;
-    *y = 0.0;
-    *xSquared = 0.0;
-    *xy = 0.0;
-    for( size_t i = 0; i < size; i++ ) {
-      *x += data[i].x;
-      *y += data[i].y;
-      *xSquared += data[i].x * data[i].x;
-      *xy += data[i].x * data[i].y;
-    }
+    double out[5];
+    sumsKernels<double, double>().points(data, size, out);
+    *x = out[0];
+    *y = out[1];
+    *xSquared = out[2];
+    *xy = out[3];
+  }
+
+  // getSums
+  // Get requisite sums (sigmas) for the best fit calculations
+  // Entry: columnar data set
+  //        pointer to destination x variable
+  //        pointer to destination y variable
+  //        pointer to sum of x²
+  //        pointer to sum of xy
+  void getSums(
+      const hedger::DataSet &data,
+      double *x,
+      double *y,
+      double *xSquared,
+      double *xy
+      )
+  {
+    double out[5];
+    sumsKernels<double, double>().columns(data.x(), data.y(), data.size(), out);
+    *x = out[0];
+    *y = out[1];
+    *xSquared = out[2];
+    *xy = out[3];
+  }
+
+  // getSums
+  // Get requisite sums (sigmas) from interleaved points of data type T,
+  // accumulated in type A
+  // Entry: data array of {x,y} points
+  //        size of array
+  //        pointer to destination sums
+  template <typename T, typename A>
+  void getSums(const BasicDataPoint<T> *data, size_t size, BasicSums<A> *sums)
+  {
+    A out[5];
+    sumsKernels<T, A>().points(data, size, out);
+    sums->n = size;
+    sums->x = out[0];
+    sums->y = out[1];
+    sums->xSquared = out[2];
+    sums->xy = out[3];
+    sums->ySquared = out[4];
+  }
+
+  // getSums
+  // Get requisite sums (sigmas) from separate x and y arrays of data type
+  // T, accumulated in type A
+  // Entry: x column
+  //        y column
+  //        # of points
+  //        pointer to destination sums
+  template <typename T, typename A>
+  void getSums(const T *xs, const T *ys, size_t size, BasicSums<A> *sums)
+  {
+    A out[5];
+    sumsKernels<T, A>().columns(xs, ys, size, out);
+    sums->n = size;
+    sums->x = out[0];
+    sums->y = out[1];
+    sums->xSquared = out[2];
+    sums->xy = out[3];
+    sums->ySquared = out[4];
   }
 
   // getMean
@@ -92,22 +897,31 @@ namespace hedger {
     return sum;
   }
 
+  // getMean
+  // Get x mean (x̄); reads only the x column
+  // Entry: columnar data set
+  double getMean(const hedger::DataSet &data)
+  {
+    const double *x = data.x();
+    size_t size = data.size();
+    double sum = 0.0;
+    for( size_t i = 0; i < size; i++ ) {
+      sum += x[i];
+    }
+    sum /= size;
+    return sum;
+  }
+
   // getBestFit
   //
-  // Get the best slope m and baseline b from a set of {x,y} points.
+  // Get the best slope m and baseline b from accumulated sums.
   //
-  // Entry: pointer to data
-  //        # of datum
+  // Entry: sums over the data
   //        pointer to baseline b result
   //        pointer to slope m result
-  void getBestFit(hedger::DataPoint *data, size_t size, double *b, double *m)
+  template <typename A>
+  void getBestFit(const BasicSums<A> &sums, A *b, A *m)
   {
-    double sigmaX = 0.0, sigmaY = 0.0;
-    double sigmaXY = 0.0;
-    double sigmaXSquared = 0.0;
-    // Sum x and y and their squares
-    getSums(data, size, &sigmaX, &sigmaY, &sigmaXSquared, &sigmaXY);
-
     //
     //         N Σ(xy) − Σx Σy
     //    m = -----------------
@@ -120,29 +934,118 @@ namespace hedger {
     //
     //    y = mx + b
     //
-    *m = size * (sigmaXY) - (sigmaX * sigmaY);
-    *m /= (size * sigmaXSquared) - sigmaX * sigmaX;
-    *b = sigmaY - *m * sigmaX;
-    *b /= size;
+    *m = sums.n * (sums.xy) - (sums.x * sums.y);
+    *m /= (sums.n * sums.xSquared) - sums.x * sums.x;
+    *b = sums.y - *m * sums.x;
+    *b /= sums.n;
   }
 
-  // getLeastSquares
+  // getBestFit
   //
-  // Get ordinary least squares regression on a set of { x, y } data
-  // (slight rearrangement of getBestFit equation)
+  // Get the best slope m and baseline b from a set of {x,y} points.
   //
   // Entry: pointer to data
   //        # of datum
-  //        pointer to a result
-  //        pointer to b result
-  void getLeastSquares(hedger::DataPoint *data, size_t size, double *a, double *b)
+  //        pointer to baseline b result
+  //        pointer to slope m result
+  template <typename T, typename A>
+  void getBestFit(const BasicDataPoint<T> *data, size_t size, A *b, A *m)
+  {
+    BasicSums<A> sums;
+    // Sum x and y and their squares
+    getSums(data, size, &sums);
+    getBestFit(sums, b, m);
+  }
+
+  // getBestFit
+  //
+  // Get the best slope m and baseline b from a columnar data set.
+  //
+  // Entry: data set
+  //        pointer to baseline b result
+  //        pointer to slope m result
+  void getBestFit(const hedger::DataSet &data, double *b, double *m)
   {
-    double sigmaX = 0.0, sigmaY = 0.0;
-    double sigmaXY = 0.0;
-    double sigmaXSquared = 0.0;
+    Sums sums;
     // Sum x and y and their squares
-    getSums(data, size, &sigmaX, &sigmaY, &sigmaXSquared, &sigmaXY);
+    getSums(data.x(), data.y(), data.size(), &sums);
+    getBestFit(sums, b, m);
+  }
+
+  // getFit
+  // Fill in a fit from accumulated sums; the means come from Σx/N and
+  // Σy/N, so no further pass over the data is needed.
+  // Entry: sums over the data
+  //        pointer to destination fit
+  void getFit(const Sums &sums, Fit *fit)
+  {
+    fit->sums = sums;
+    fit->xMean = sums.x / sums.n;
+    fit->yMean = sums.y / sums.n;
+    getBestFit(sums, &fit->b, &fit->m);
+    fit->yAtMean = fit->m * fit->xMean + fit->b;
+    getFitStatistics(sums.n, sums.n,
+        sums.xSquared - sums.x * fit->xMean,
+        sums.ySquared - sums.y * fit->yMean,
+        sums.xy - sums.x * fit->yMean,
+        fit);
+  }
+
+  // getFitStatistics
+  // Fill in the goodness of fit of a fit whose slope and x̄ are set, from
+  // the centered sums of squares and products.  The residual sum of
+  // squares is Syy − m Sxy, so it needs no pass over the residuals.
+  // Weighted fits pass weighted sums and Σw; unweighted ones pass N.
+  // Entry: # of points
+  //        total weight
+  //        Sxx = Σ(x-x̄)²
+  //        Syy = Σ(y-ȳ)²
+  //        Sxy = Σ(x-x̄)(y-ȳ)
+  //        pointer to fit
+  void getFitStatistics(size_t n, double weight, double sxx, double syy, double sxy, Fit *fit)
+  {
+    // Cancellation can leave the residual a hair below zero on exact fits
+    double residual = std::max(0.0, syy - fit->m * sxy);
+    fit->r2 = syy > 0.0 ? 1.0 - residual / syy : 1.0;
+    fit->residualVariance = n > 2 ? residual / (n - 2) : NAN;
+    fit->slopeError = sqrt(fit->residualVariance / sxx);
+    fit->baselineError = sqrt(fit->residualVariance * (1.0 / weight + fit->xMean * fit->xMean / sxx));
+  }
+
+  // getFit
+  // Fit a set of {x,y} points in a single getSums pass.
+  // Entry: pointer to data
+  //        # of datum
+  //        pointer to destination fit
+  void getFit(hedger::DataPoint *data, size_t size, Fit *fit)
+  {
+    Sums sums;
+    getSums(data, size, &sums);
+    getFit(sums, fit);
+  }
+
+  // getFit
+  // Fit a columnar data set in a single getSums pass.
+  // Entry: data set
+  //        pointer to destination fit
+  void getFit(const hedger::DataSet &data, Fit *fit)
+  {
+    Sums sums;
+    getSums(data.x(), data.y(), data.size(), &sums);
+    getFit(sums, fit);
+  }
 
+  // getLeastSquares
+  //
+  // Get ordinary least squares regression from accumulated sums
+  // (slight rearrangement of getBestFit equation)
+  //
+  // Entry: sums over the data
+  //        pointer to a result
+  //        pointer to b result
+  template <typename A>
+  void getLeastSquares(const BasicSums<A> &sums, A *a, A *b)
+  {
     // Now calculate a and b per standard linear regression equation
     //
     //      (sigma y)(sigma x^2) - (sigma x)(sigma xy)
@@ -153,127 +1056,65 @@ namespace hedger {
     // b =  --------------------------------
     //           n(sigma x^2) - (sigma x)^2
     //
-    *a = (sigmaY * sigmaXSquared) - (sigmaX * sigmaXY);
-    *a /= (size * sigmaXSquared) - (sigmaX * sigmaX);
-    *b = (size * sigmaXY) - (sigmaX * sigmaY);
-    *b /= (size * sigmaXSquared) - (sigmaX * sigmaX);
-  }
-
-  // parseFile
-  // Parses a CSV or other non-numeric value separated file and gets the data into an array of DataPoints.
-  // Entry: filename
-  // Exit: pointer to DataPoint array
-  DataPoint *parseFile(const char *file, int *data_size) {
-    vector<double> x, y;
-    int tuples = 0;
-    bool xy = false;
-    const int MAX_DIGITS = 256;
-    char accum[MAX_DIGITS], c;
-    int aidx = 0; // accumulator index
-    double d = 0.0;
-    DataPoint *data = NULL;
-    FILE *f = fopen(file, "r");
-    if (f) {
-      while ((c = fgetc(f)) != EOF) {
-        //printf("%c", c);
-        if (isdigit(c) || '.' == c || '-' == c) {
-          if (aidx > MAX_DIGITS) {
-            x.clear();
-            y.clear();
-            // Error;
-            return NULL;
-          }
-          accum[aidx++] = c; //  read into number accumulator
-        } else {
-          // Nondigit,nunumeric; terminate, read whole # from accumulator
-          accum[aidx] = '\0'; // null terminate
-          aidx = 0; // reset accum index
-          sscanf(accum, "%lf", &d);
-          if (xy) {
-            y.push_back(d);
-            tuples++;
-          } else {
-            x.push_back(d);
-          }
-          xy ^= true; // Toggle x/y
-        }
-      }
-      // Allocate data source and free up lists
-      data = new DataPoint[tuples];
-      for (auto i = 0; i < tuples; i++) {
-        data[i].x = x[i];
-        data[i].y = y[i];
-      }
-      x.clear();
-      y.clear();
-      // Set data size
-      *data_size = tuples;
-    }
-    return data;
-  }
-
-} // namespace hedger
-
-static const int DATA_SIZE = 6;
-int main(int argc, const char *argv[])
-{
-  using namespace hedger;
-  DataPoint *data = NULL;
-  int data_size = 0;
-
-  if (argc < 5) {
-    if (argc > 2) {
-      if (!strcmp(argv[1], "-f") || !strcmp(argv[1], "-xf")) {
-        data = parseFile(argv[2], &data_size);
-        if (!data) {
-          printf("Could not read or allocate data, file '%s'\n", argv[2]);
-          return -1;
-        }
-        if (!strcmp(argv[1], "-xf")) {
-          for (auto i = 0; i < data_size; i++) {
-            double swap = data[i].y;
-            data[i].y = data[i].x;
-            data[i].x = swap;
-          }
-        }
-      }
-    } else {
-      printUsage();
-      return 1;
-    }
+    *a = (sums.y * sums.xSquared) - (sums.x * sums.xy);
+    *a /= (sums.n * sums.xSquared) - (sums.x * sums.x);
+    *b = (sums.n * sums.xy) - (sums.x * sums.y);
+    *b /= (sums.n * sums.xSquared) - (sums.x * sums.x);
   }
 
-  // Pull in arguments from command line, if and only if we are not
-  // parsing from a file.
-  if (!data) {
-    data_size = (argc - 1) / 2;
-    data = new DataPoint[ data_size ];
-    double v;
-    for (int i = 0; i < data_size; i++) {
-      sscanf(argv[ 1 + i * 2 ], "%lf", &v);
-      data[ i ].x = v;
-      sscanf(argv[ 1 + i * 2 + 1 ], "%lf", &v);
-      data[ i ].y = v;
-    }
+  // getLeastSquares
+  //
+  // Get ordinary least squares regression on a set of { x, y } data
+  //
+  // Entry: pointer to data
+  //        # of datum
+  //        pointer to a result
+  //        pointer to b result
+  template <typename T, typename A>
+  void getLeastSquares(const BasicDataPoint<T> *data, size_t size, A *a, A *b)
+  {
+    BasicSums<A> sums;
+    // Sum x and y and their squares
+    getSums(data, size, &sums);
+    getLeastSquares(sums, a, b);
   }
 
-  // Warn if odd # of arguments
-  if (data_size * 2 < (argc - 1)) {
-    printf("\nWARNING: Ignoring last param!");
+  // getLeastSquares
+  //
+  // Get ordinary least squares regression on a columnar data set
+  //
+  // Entry: data set
+  //        pointer to a result
+  //        pointer to b result
+  void getLeastSquares(const hedger::DataSet &data, double *a, double *b)
+  {
+    Sums sums;
+    // Sum x and y and their squares
+    getSums(data.x(), data.y(), data.size(), &sums);
+    getLeastSquares(sums, a, b);
   }
 
-  // Get the Y baseline ("b") and slope ("m")
-  double m = 0.0, b = 0.0;
-  getBestFit( data, data_size, &b, &m );
-  printf("Best fit (OLS):\n");
-  printf("b=%lf\nm=%lf\n", b, m);
+  // Explicit instantiations for every supported accumulator type A and
+  // data type T summed in A
+#define INSTANTIATE_SUMS(A) \
+  template void getBestFit<A>(const BasicSums<A> &, A *, A *); \
+  template void getLeastSquares<A>(const BasicSums<A> &, A *, A *);
+#define INSTANTIATE_DATA(T, A) \
+  template void getSums<T, A>(const BasicDataPoint<T> *, size_t, BasicSums<A> *); \
+  template void getSums<T, A>(const T *, const T *, size_t, BasicSums<A> *); \
+  template void getBestFit<T, A>(const BasicDataPoint<T> *, size_t, A *, A *); \
+  template void getLeastSquares<T, A>(const BasicDataPoint<T> *, size_t, A *, A *);
 
-  double xbar = getMean( data, data_size );
+  INSTANTIATE_SUMS(float)
+  INSTANTIATE_SUMS(double)
+  INSTANTIATE_SUMS(long double)
+  INSTANTIATE_DATA(float, float)
+  INSTANTIATE_DATA(float, double)
+  INSTANTIATE_DATA(double, double)
+  INSTANTIATE_DATA(double, long double)
+  INSTANTIATE_DATA(long double, long double)
 
-  // Print y at center point x-bar
-  printf("\ny=%lf at x=x̄=%lf\n", m*xbar + b, xbar);
+#undef INSTANTIATE_SUMS
+#undef INSTANTIATE_DATA
 
-  // Free resources and exit
-  delete data;
-  return 0;
-}
+} // namespace hedger
@@ -0,0 +1,228 @@
+// reproducible.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+// Sums that come out bit for bit the same for any thread count.
+//
+// The chunks are fixed by position, not by thread, each chunk is summed
+// lane by lane with compensation, and chunk results are combined in a
+// fixed tree, so threads only change who computes each chunk.  Every
+// kernel does the same additions in the same order, which relies on the
+// build leaving products and sums unfused (-std=c++11 implies
+// -ffp-contract=off).
+//
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "regression.h"
+#include "stats.h"
+
+using namespace std;
+
+namespace hedger {
+  static const size_t LANES = 4;          // point i goes to lane i % LANES
+  static const size_t CHUNK = 1 << 16;    // points per chunk, whatever the threads
+  static const int SIGMAS = 5;            // Σx, Σy, Σx², Σxy, Σy²
+
+  // CompensatedSum
+  // A sum and the accumulated rounding error of forming it
+  struct CompensatedSum {
+    double sum;
+    double error;
+  };
+
+  struct ChunkSums {
+    CompensatedSum sigma[SIGMAS];
+  };
+
+  // Per lane sums and errors while a chunk is summed
+  struct LaneSums {
+    double sum[SIGMAS][LANES];
+    double error[SIGMAS][LANES];
+  };
+
+  // twoSum
+  // s = a + b rounded, and e the exact rounding error, so a + b = s + e
+  // (Knuth); branch free, unlike Neumaier's comparison
+  static inline void twoSum(double a, double b, double *s, double *e)
+  {
+    *s = a + b;
+    double z = *s - a;
+    *e = (a - (*s - z)) + (b - z);
+  }
+
+  // addPoint
+  // Add one point to its lane
+  static inline void addPoint(double x, double y, size_t lane, LaneSums *lanes)
+  {
+    double v[SIGMAS] = { x, y, x * x, x * y, y * y };
+    for (int k = 0; k < SIGMAS; k++) {
+      double e;
+      twoSum(lanes->sum[k][lane], v[k], &lanes->sum[k][lane], &e);
+      lanes->error[k][lane] += e;
+    }
+  }
+
+  // Chunk kernels
+  // Sum points into lanes; every kernel produces the same bits
+  typedef void (*ChunkKernel)(const double *xs, const double *ys, size_t size, LaneSums *lanes);
+
+  static void sumChunkScalar(const double *xs, const double *ys, size_t size, LaneSums *lanes)
+  {
+    for (size_t i = 0; i < size; i++) {
+      addPoint(xs[i], ys[i], i % LANES, lanes);
+    }
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  // One register of LANES per sum and per error
+  __attribute__((target("avx2")))
+  static void sumChunkAvx2(const double *xs, const double *ys, size_t size, LaneSums *lanes)
+  {
+    __m256d s[SIGMAS], e[SIGMAS];
+    for (int k = 0; k < SIGMAS; k++) {
+      s[k] = _mm256_loadu_pd(lanes->sum[k]);
+      e[k] = _mm256_loadu_pd(lanes->error[k]);
+    }
+    size_t i = 0;
+    for (; i + LANES <= size; i += LANES) {
+      __m256d x = _mm256_loadu_pd(xs + i), y = _mm256_loadu_pd(ys + i);
+      __m256d v[SIGMAS] = {
+        x, y, _mm256_mul_pd(x, x), _mm256_mul_pd(x, y), _mm256_mul_pd(y, y)
+      };
+      for (int k = 0; k < SIGMAS; k++) {
+        __m256d t = _mm256_add_pd(s[k], v[k]);
+        __m256d z = _mm256_sub_pd(t, s[k]);
+        __m256d error = _mm256_add_pd(_mm256_sub_pd(s[k], _mm256_sub_pd(t, z)),
+            _mm256_sub_pd(v[k], z));
+        e[k] = _mm256_add_pd(e[k], error);
+        s[k] = t;
+      }
+    }
+    for (int k = 0; k < SIGMAS; k++) {
+      _mm256_storeu_pd(lanes->sum[k], s[k]);
+      _mm256_storeu_pd(lanes->error[k], e[k]);
+    }
+    for (; i < size; i++) {
+      addPoint(xs[i], ys[i], i % LANES, lanes);
+    }
+  }
+#endif
+
+  static ChunkKernel selectChunkKernel()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return sumChunkAvx2;
+    }
+#endif
+    return sumChunkScalar;
+  }
+
+  // combine
+  // Add two compensated sums; the rounding error of adding the sums
+  // joins the errors carried by both
+  static CompensatedSum combine(const CompensatedSum &a, const CompensatedSum &b)
+  {
+    CompensatedSum c;
+    double e;
+    twoSum(a.sum, b.sum, &c.sum, &e);
+    c.error = (a.error + b.error) + e;
+    return c;
+  }
+
+  // sumChunk
+  // Sum one chunk and fold its lanes in lane order
+  static void sumChunk(ChunkKernel kernel, const double *xs, const double *ys, size_t size,
+      ChunkSums *chunk)
+  {
+    LaneSums lanes = {};
+    kernel(xs, ys, size, &lanes);
+    for (int k = 0; k < SIGMAS; k++) {
+      CompensatedSum total = { lanes.sum[k][0], lanes.error[k][0] };
+      for (size_t l = 1; l < LANES; l++) {
+        CompensatedSum lane = { lanes.sum[k][l], lanes.error[k][l] };
+        total = combine(total, lane);
+      }
+      chunk->sigma[k] = total;
+    }
+  }
+
+  // combineTree
+  // Combine chunks [begin, end) as a balanced tree split at the midpoint
+  static ChunkSums combineTree(const vector<ChunkSums> &chunks, size_t begin, size_t end)
+  {
+    if (end - begin == 1) {
+      return chunks[begin];
+    }
+    size_t mid = begin + (end - begin) / 2;
+    ChunkSums left = combineTree(chunks, begin, mid), right = combineTree(chunks, mid, end);
+    ChunkSums both;
+    for (int k = 0; k < SIGMAS; k++) {
+      both.sigma[k] = combine(left.sigma[k], right.sigma[k]);
+    }
+    return both;
+  }
+
+  void getSumsReproducible(const DataSet &data, unsigned threads, Sums *sums)
+  {
+    static const ChunkKernel kernel = selectChunkKernel();
+    STATS_TIMER(STATS_SUMS);
+    size_t size = data.size();
+    *sums = Sums();
+    if (!size) {
+      return;
+    }
+    size_t count = (size + CHUNK - 1) / CHUNK;
+    if (!threads) {
+      threads = std::thread::hardware_concurrency();
+    }
+    threads = std::max(1u, std::min<unsigned>(threads, count));
+
+    vector<ChunkSums> chunks(count);
+    const double *xs = data.x(), *ys = data.y();
+    auto sumRange = [&chunks, xs, ys, size, count, threads](unsigned t) {
+      for (size_t c = count * t / threads; c < count * (t + 1) / threads; c++) {
+        size_t begin = c * CHUNK;
+        sumChunk(kernel, xs + begin, ys + begin, std::min(CHUNK, size - begin), &chunks[c]);
+      }
+    };
+    vector<std::thread> workers;
+    for (unsigned t = 1; t < threads; t++) {
+      workers.push_back(std::thread(sumRange, t));
+    }
+    sumRange(0);
+    for (size_t i = 0; i < workers.size(); i++) {
+      workers[i].join();
+    }
+
+    ChunkSums total = combineTree(chunks, 0, count);
+    sums->n = size;
+    sums->x = total.sigma[0].sum + total.sigma[0].error;
+    sums->y = total.sigma[1].sum + total.sigma[1].error;
+    sums->xSquared = total.sigma[2].sum + total.sigma[2].error;
+    sums->xy = total.sigma[3].sum + total.sigma[3].error;
+    sums->ySquared = total.sigma[4].sum + total.sigma[4].error;
+  }
+} // namespace hedger
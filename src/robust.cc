@@ -0,0 +1,530 @@
+// robust.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+// Robust (Theil–Sen) fits: the median of the pairwise slopes, selected
+// without listing all N(N-1)/2 of them.
+//
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "regression.h"
+#include "stats.h"
+
+using namespace std;
+
+namespace hedger {
+  // mergeInversions
+  // Stable bottom-up merge sort that counts inversions, pairs of keys out
+  // of order.  Each right key taken ahead of left keys is inverted with
+  // all of them, so inversions come in runs, numbered in merge order.
+  // The merge step is branch free; the visitor is called only for a run
+  // holding inversion number visit.next, so counting alone never calls it.
+  // Entry: keys, sorted in place
+  //        scratch space
+  //        visitor(const T *left, size_t count, const T &right, uint64_t first)
+  //        with first the number of the run's first inversion
+  // Exit: # of inversions
+  template <typename T, typename Visitor>
+  static uint64_t mergeInversions(vector<T> *keys, vector<T> *scratch, Visitor &visit)
+  {
+    size_t n = keys->size();
+    scratch->resize(n);
+    T *src = keys->data(), *dst = scratch->data();
+    uint64_t total = 0;
+    for (size_t width = 1; width < n; width *= 2) {
+      for (size_t begin = 0; begin < n; begin += 2 * width) {
+        size_t mid = std::min(begin + width, n), end = std::min(begin + 2 * width, n);
+        size_t a = begin, b = mid, out = begin;
+        while (a < mid && b < end) {
+          bool right = src[b] < src[a];
+          size_t run = right ? mid - a : 0;
+          if (visit.next < total + run) {
+            visit(src + a, run, src[b], total);
+          }
+          total += run;
+          dst[out++] = *(right ? src + b : src + a);
+          b += right;
+          a += !right;
+        }
+        std::copy(src + a, src + mid, dst + out);
+        std::copy(src + b, src + end, dst + out + (mid - a));
+      }
+      std::swap(src, dst);
+    }
+    if (src != keys->data()) {
+      std::copy(src, src + n, keys->data());
+    }
+    return total;
+  }
+
+  // Point index with its y - t x, ordered by the latter and then by tie,
+  // so the stable merge keeps ties of both in index order
+  struct Projection {
+    double u;
+    uint32_t index;
+    uint32_t tie;
+    bool operator<(const Projection &other) const
+    {
+      return u < other.u || (u == other.u && tie < other.tie);
+    }
+  };
+
+  struct InversionCounter {
+    InversionCounter() : next(UINT64_MAX) {}
+    template <typename T>
+    void operator()(const T *, size_t, const T &, uint64_t) {}
+    uint64_t next;
+  };
+
+  // SlopeSelector
+  // With the points sorted by x (ties by y), the slope of a pair i < j is
+  // below t exactly when y - t x puts j ahead of i.  So the slopes below
+  // t are the inversions of the points ordered by y - t x, and the slopes
+  // in [lo, hi) are the pairs the lo and hi orders disagree on.  Both can
+  // be counted, sampled or listed in O(N log N) plus what is listed.
+  // Pairs with equal x are in order under every t and never counted.
+  class SlopeSelector {
+  public:
+    explicit SlopeSelector(const DataSet &data) : pairs_(0)
+    {
+      size_t n = data.size();
+      vector<uint32_t> order(n);
+      for (size_t i = 0; i < n; i++) {
+        order[i] = i;
+      }
+      const double *xs = data.x(), *ys = data.y();
+      std::sort(order.begin(), order.end(), [xs, ys](uint32_t a, uint32_t b) {
+        return xs[a] < xs[b] || (xs[a] == xs[b] && ys[a] < ys[b]);
+      });
+      x_.resize(n);
+      y_.resize(n);
+      for (size_t i = 0; i < n; i++) {
+        x_[i] = xs[order[i]];
+        y_[i] = ys[order[i]];
+      }
+      // All pairs less those within runs of equal x; later runs tie first
+      pairs_ = n > 1 ? (uint64_t) n * (n - 1) / 2 : 0;
+      above_.resize(n);
+      for (size_t i = 0, run; i < n; i += run) {
+        for (run = 1; i + run < n && x_[i + run] == x_[i]; run++) {
+        }
+        pairs_ -= (uint64_t) run * (run - 1) / 2;
+        std::fill(above_.begin() + i, above_.begin() + i + run, n - i);
+      }
+    }
+
+    uint64_t pairs() const { return pairs_; }
+    const vector<double> &x() const { return x_; }
+    const vector<double> &y() const { return y_; }
+
+    double slope(uint32_t i, uint32_t j) const
+    {
+      return (y_[j] - y_[i]) / (x_[j] - x_[i]);
+    }
+
+    // slopeRange
+    // Extreme slopes are always between neighbouring distinct x, so one
+    // walk over the runs of equal x finds them.
+    void slopeRange(double *least, double *most) const
+    {
+      *least = INFINITY;
+      *most = -INFINITY;
+      size_t n = x_.size(), previous = 0, run;
+      for (size_t i = 0; i < n; i += run) {
+        for (run = 1; i + run < n && x_[i + run] == x_[i]; run++) {
+        }
+        if (i > 0) {
+          // Runs are sorted by y: [previous, i) then [i, i + run)
+          double dx = x_[i] - x_[previous];
+          *least = std::min(*least, (y_[i] - y_[i - 1]) / dx);
+          *most = std::max(*most, (y_[i + run - 1] - y_[previous]) / dx);
+        }
+        previous = i;
+      }
+    }
+
+    // project
+    // Order the points by y - t x, ties in index order
+    // Entry: slope t
+    //        destination order
+    // Exit: # of slopes below t
+    uint64_t project(double t, vector<uint32_t> *order)
+    {
+      return project(t, false, order);
+    }
+
+    // projectAbove
+    // Order the points as just above t, ties in y - t x by descending x.
+    // Counting a slope equal to t from the tie alone, rather than from
+    // y - t x at nextafter(t), which may round back to the same order.
+    // Entry: slope t
+    //        destination order
+    // Exit: # of slopes at or below t
+    uint64_t projectAbove(double t, vector<uint32_t> *order)
+    {
+      return project(t, true, order);
+    }
+
+    // between
+    // Visit the slopes in [lo, hi) as runs of point pairs
+    // Entry: order at lo, from project
+    //        order at hi
+    //        visitor as for mergeInversions, over positions in the hi order
+    template <typename Visitor>
+    void between(const vector<uint32_t> &lo, const vector<uint32_t> &hi, Visitor &visit)
+    {
+      size_t n = lo.size();
+      rank_.resize(n);
+      for (size_t i = 0; i < n; i++) {
+        rank_[hi[i]] = i;
+      }
+      positions_.resize(n);
+      for (size_t i = 0; i < n; i++) {
+        positions_[i] = rank_[lo[i]];
+      }
+      mergeInversions(&positions_, &positionScratch_, visit);
+    }
+
+  private:
+    uint64_t project(double t, bool above, vector<uint32_t> *order)
+    {
+      size_t n = x_.size();
+      projections_.resize(n);
+      for (size_t i = 0; i < n; i++) {
+        projections_[i].u = y_[i] - t * x_[i];
+        projections_[i].index = i;
+        projections_[i].tie = above ? above_[i] : 0;
+      }
+      InversionCounter counter;
+      uint64_t below = mergeInversions(&projections_, &scratch_, counter);
+      order->resize(n);
+      for (size_t i = 0; i < n; i++) {
+        (*order)[i] = projections_[i].index;
+      }
+      return below;
+    }
+
+    vector<double> x_, y_;
+    vector<uint32_t> above_;
+    uint64_t pairs_;
+    vector<Projection> projections_, scratch_;
+    vector<uint32_t> rank_, positions_, positionScratch_;
+  };
+
+  // SlopeSampler
+  // Collects the slopes at given sorted ranks of a between() walk
+  struct SlopeSampler {
+    SlopeSampler(const SlopeSelector &selector, const vector<uint32_t> &hi,
+        const vector<uint64_t> &ranks, vector<double> *slopes) :
+      selector(selector), hi(hi), ranks(ranks), slopes(slopes), sampled(0),
+      next(ranks.empty() ? UINT64_MAX : ranks[0]) {}
+    void operator()(const uint32_t *left, size_t count, uint32_t right, uint64_t first)
+    {
+      for (; sampled < ranks.size() && ranks[sampled] < first + count; sampled++) {
+        slopes->push_back(selector.slope(hi[left[ranks[sampled] - first]], hi[right]));
+      }
+      next = sampled < ranks.size() ? ranks[sampled] : UINT64_MAX;
+    }
+    const SlopeSelector &selector;
+    const vector<uint32_t> &hi;
+    const vector<uint64_t> &ranks;
+    vector<double> *slopes;
+    size_t sampled;
+    uint64_t next;
+  };
+
+  // SlopeLister
+  // Collects every slope of a between() walk
+  struct SlopeLister {
+    SlopeLister(const SlopeSelector &selector, const vector<uint32_t> &hi, vector<double> *slopes) :
+      selector(selector), hi(hi), slopes(slopes), next(0) {}
+    void operator()(const uint32_t *left, size_t count, uint32_t right, uint64_t first)
+    {
+      for (size_t i = 0; i < count; i++) {
+        slopes->push_back(selector.slope(hi[left[i]], hi[right]));
+      }
+      next = first + count;
+    }
+    const SlopeSelector &selector;
+    const vector<uint32_t> &hi;
+    vector<double> *slopes;
+    uint64_t next;
+  };
+
+  // quantileBounds
+  // Bounds a few standard errors either side of two ranks, from sorted
+  // sample slopes; 2/√s either side is about 4σ for any quantile
+  // Entry: sorted sample
+  //        lower rank, as a fraction of the slopes in [lo, hi)
+  //        upper rank, likewise
+  //        pointer to lo, replaced by the lower bound if within the sample
+  //        pointer to hi, likewise the upper bound
+  static void quantileBounds(const vector<double> &slopes, double p1, double p2,
+      double *lo, double *hi)
+  {
+    size_t s = slopes.size();
+    if (!s) {
+      return;
+    }
+    double margin = 2.0 / sqrt((double) s);
+    p1 -= margin;
+    p2 += margin;
+    if (p1 > 0.0) {
+      *lo = std::max(*lo, slopes[(size_t) (p1 * s)]);
+    }
+    if (p2 < 1.0) {
+      *hi = std::min(*hi, nextafter(slopes[std::min(s - 1, (size_t) (p2 * s))], INFINITY));
+    }
+  }
+
+  // median
+  // Median of values, averaging the middle two of an even count
+  // Entry: values, reordered
+  static double median(vector<double> *values)
+  {
+    size_t n = values->size(), middle = n / 2;
+    std::nth_element(values->begin(), values->begin() + middle, values->end());
+    double upper = (*values)[middle];
+    if (n % 2) {
+      return upper;
+    }
+    return (upper + *std::max_element(values->begin(), values->begin() + middle)) / 2;
+  }
+
+  // SlopeBracket
+  // Slope values [lo, hi), with the # of slopes below and the point
+  // order at each end
+  struct SlopeBracket {
+    double lo, hi;
+    uint64_t loCount, hiCount;
+    vector<uint32_t> loOrder, hiOrder;
+  };
+
+  static const size_t SLOPE_SAMPLES = 1 << 20;
+
+  // selectSlopes
+  // Randomized slope selection (after Matoušek) within a bracket known to
+  // hold ranks r1 ≤ r2 ≤ r1 + 1.  Each round samples slopes uniformly from
+  // the bracket, takes sample quantiles a few standard errors either side
+  // of the ranks as new bounds, and counts the slopes below them to pick
+  // the subinterval that still holds the ranks.  A round that moves
+  // nothing bisects next instead; a bound falling between the two ranks
+  // splits the search in two.  Once few enough slopes remain they are
+  // listed and the ranks selected exactly.
+  // Entry: selector
+  //        random source
+  //        # of slopes few enough to list
+  //        ranks r1 and r2, 0-based
+  //        pointer to bracket, narrowed
+  // Exit: slopes at r1 and r2
+  static void selectSlopes(SlopeSelector &selector, std::mt19937_64 &random, uint64_t listable,
+      uint64_t r1, uint64_t r2, SlopeBracket *bracket, double *v1, double *v2)
+  {
+    double &lo = bracket->lo, &hi = bracket->hi;
+    uint64_t &loCount = bracket->loCount, &hiCount = bracket->hiCount;
+    vector<uint32_t> &loOrder = bracket->loOrder, &hiOrder = bracket->hiOrder;
+    vector<uint32_t> order1, order2;
+    vector<uint64_t> ranks;
+    vector<double> slopes;
+    bool stalled = false;
+    while (hiCount - loCount > listable && nextafter(lo, INFINITY) < hi) {
+      uint64_t inside = hiCount - loCount;
+      double t1 = lo, t2 = hi;
+      if (!stalled) {
+        std::uniform_int_distribution<uint64_t> pick(0, inside - 1);
+        ranks.resize(SLOPE_SAMPLES);
+        for (size_t i = 0; i < SLOPE_SAMPLES; i++) {
+          ranks[i] = pick(random);
+        }
+        std::sort(ranks.begin(), ranks.end());
+        slopes.clear();
+        SlopeSampler sampler(selector, hiOrder, ranks, &slopes);
+        selector.between(loOrder, hiOrder, sampler);
+        std::sort(slopes.begin(), slopes.end());
+        quantileBounds(slopes, (double) (r1 - loCount) / inside,
+            (double) (r2 + 1 - loCount) / inside, &t1, &t2);
+      }
+      if (t1 <= lo && t2 >= hi) {
+        // No usable quantiles; bisect instead
+        t1 = lo + (hi - lo) / 2;
+      }
+      uint64_t count1 = t1 > lo ? selector.project(t1, &order1) : loCount;
+      // t2 sits just above a slope, so count up to that slope
+      uint64_t count2 = t2 < hi && t2 > t1 ?
+        selector.projectAbove(nextafter(t2, -INFINITY), &order2) : hiCount;
+      if (count1 <= r1 && count2 > r2 && nextafter(t1, INFINITY) >= t2) {
+        // Both ranks in [t1, t2), which holds the one value t1
+        *v1 = *v2 = t1;
+        return;
+      }
+
+      // Narrowest of lo ≤ t1 ≤ t2 ≤ hi still holding both ranks
+      double lastLo = lo, lastHi = hi;
+      if (t2 < hi && t2 > t1 && count2 <= r1) {
+        lo = t2;
+        loCount = count2;
+        loOrder.swap(order2);
+      } else if (t1 > lo && count1 <= r1) {
+        lo = t1;
+        loCount = count1;
+        loOrder.swap(order1);
+      }
+      if (t1 > lo && t1 < hi && count1 > r2) {
+        hi = t1;
+        hiCount = count1;
+        hiOrder.swap(order1);
+      } else if (t2 > lo && t2 < hi && count2 > r2) {
+        hi = t2;
+        hiCount = count2;
+        hiOrder.swap(order2);
+      }
+
+      // A bound with r1 below it and r2 not is between two distinct
+      // values: find each alone, on its own side
+      double split = NAN;
+      uint64_t splitCount = 0;
+      vector<uint32_t> *splitOrder = NULL;
+      if (r1 < r2 && t1 > lo && t1 < hi && count1 == r2) {
+        split = t1;
+        splitCount = count1;
+        splitOrder = &order1;
+      } else if (r1 < r2 && t2 > lo && t2 < hi && count2 == r2) {
+        split = t2;
+        splitCount = count2;
+        splitOrder = &order2;
+      }
+      if (splitOrder) {
+        SlopeBracket upper;
+        upper.lo = split;
+        upper.loCount = splitCount;
+        upper.loOrder = *splitOrder;
+        upper.hi = hi;
+        upper.hiCount = hiCount;
+        upper.hiOrder.swap(hiOrder);
+        hi = split;
+        hiCount = splitCount;
+        hiOrder.swap(*splitOrder);
+        double unused;
+        selectSlopes(selector, random, listable, r1, r1, bracket, v1, &unused);
+        selectSlopes(selector, random, listable, r2, r2, &upper, &unused, v2);
+        return;
+      }
+      stalled = lo == lastLo && hi == lastHi;
+    }
+
+    if (nextafter(lo, INFINITY) >= hi) {
+      // Every remaining slope is lo
+      *v1 = *v2 = lo;
+      return;
+    }
+    slopes.clear();
+    SlopeLister lister(selector, hiOrder, &slopes);
+    selector.between(loOrder, hiOrder, lister);
+    if (slopes.empty()) {
+      *v1 = *v2 = lo;
+      return;
+    }
+    size_t last = slopes.size() - 1;
+    size_t i1 = std::min<uint64_t>(r1 - loCount, last);
+    size_t i2 = std::min<uint64_t>(r2 - loCount, last);
+    std::nth_element(slopes.begin(), slopes.begin() + i1, slopes.end());
+    *v1 = slopes[i1];
+    *v2 = i2 == i1 ? *v1 : *std::min_element(slopes.begin() + i1 + 1, slopes.end());
+  }
+
+  // getTheilSen
+  // Theil–Sen slope by selecting the median pairwise slopes from a
+  // bracket first bounded by the slopes of random pairs; see
+  // selectSlopes.  The result is the exact Theil–Sen slope; randomness
+  // only affects the running time.  A round is three merge passes over
+  // the points and shrinks the interval by about √samples/4, so 10⁷
+  // points take two rounds.  b is the median of y - m x.
+  bool getTheilSen(const DataSet &data, double *b, double *m)
+  {
+    const uint64_t SEED = 0x7e11ULL; // fixed, so runs repeat exactly
+    size_t n = data.size();
+    if (n < 2 || n > UINT32_MAX) {
+      return false;
+    }
+    STATS_TIMER(STATS_SUMS);
+    STATS_ADD(points, n);
+    SlopeSelector selector(data);
+    uint64_t pairs = selector.pairs();
+    if (!pairs) {
+      return false;
+    }
+    // Lower and upper median ranks, 0-based
+    uint64_t lowRank = (pairs - 1) / 2, highRank = pairs / 2;
+    // Few enough to list: about the memory of the points themselves
+    uint64_t listable = std::max<uint64_t>(n, SLOPE_SAMPLES);
+
+    double least, most;
+    selector.slopeRange(&least, &most);
+    std::mt19937_64 random(SEED);
+
+    // First bounds from the slopes of random pairs, which need no orders;
+    // give up on them if nearly every pair shares its x.  The upper
+    // bound is always just above a slope, counted through that slope.
+    SlopeBracket bracket;
+    double &lo = bracket.lo, &hi = bracket.hi;
+    lo = least;
+    hi = nextafter(most, INFINITY);
+    if (pairs > listable) {
+      vector<double> slopes;
+      std::uniform_int_distribution<uint32_t> pick(0, n - 1);
+      const vector<double> &x = selector.x();
+      for (size_t draws = 0; draws < 64 * SLOPE_SAMPLES && slopes.size() < SLOPE_SAMPLES; draws++) {
+        uint32_t i = pick(random), j = pick(random);
+        if (x[i] != x[j]) {
+          slopes.push_back(selector.slope(i, j));
+        }
+      }
+      std::sort(slopes.begin(), slopes.end());
+      quantileBounds(slopes, (double) lowRank / pairs, (double) (highRank + 1) / pairs, &lo, &hi);
+    }
+    bracket.loCount = selector.project(lo, &bracket.loOrder);
+    if (bracket.loCount > lowRank) {
+      lo = least;
+      bracket.loCount = selector.project(lo, &bracket.loOrder);
+    }
+    bracket.hiCount = selector.projectAbove(nextafter(hi, -INFINITY), &bracket.hiOrder);
+    if (bracket.hiCount <= highRank) {
+      hi = nextafter(most, INFINITY);
+      bracket.hiCount = selector.projectAbove(most, &bracket.hiOrder);
+    }
+    // Rounding in y - t x can miscount slopes right at the extremes
+    bracket.loCount = std::min(bracket.loCount, lowRank);
+    bracket.hiCount = std::max(bracket.hiCount, highRank + 1);
+
+    double v1, v2;
+    selectSlopes(selector, random, listable, lowRank, highRank, &bracket, &v1, &v2);
+    *m = (v1 + v2) / 2;
+
+    vector<double> intercepts(n);
+    for (size_t i = 0; i < n; i++) {
+      intercepts[i] = selector.y()[i] - *m * selector.x()[i];
+    }
+    *b = median(&intercepts);
+    return true;
+  }
+} // namespace hedger
@@ -0,0 +1,221 @@
+// sample.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+// Approximate fits from a sample of the input.
+//
+
+#include <math.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "regression.h"
+#include "scanner.h"
+#include "stats.h"
+
+using namespace std;
+
+namespace hedger {
+  static const uint64_t SEED = 0x5a3b1eULL;   // fixed, so runs repeat exactly
+
+  // tQuantile
+  // Two sided 95% quantile of Student's t, from the normal quantile by
+  // the Cornish–Fisher expansion; within 0.1% from 3 degrees of freedom
+  // Entry: degrees of freedom
+  // Exit: quantile, NaN without any degree of freedom
+  static double tQuantile(double nu)
+  {
+    const double Z = 1.959963984540054;
+    if (!(nu >= 1.0)) {
+      return NAN;
+    }
+    double z2 = Z * Z;
+    double g1 = (z2 + 1) * Z / 4;
+    double g2 = ((5 * z2 + 16) * z2 + 3) * Z / 96;
+    double g3 = (((3 * z2 + 19) * z2 + 17) * z2 - 15) * Z / 384;
+    return Z + (g1 + (g2 + g3 / nu) / nu) / nu;
+  }
+
+  // getIntervals
+  // Fit the sample sums and set the confidence intervals
+  // Entry: sums over the sample
+  //        rows in the whole input
+  //        destination fit
+  static void getIntervals(const Sums &sums, size_t rows, SampledFit *fit)
+  {
+    getFit(sums, &fit->fit);
+    fit->rows = rows;
+    double n = sums.n;
+    double correction = rows ? sqrt(std::max(0.0, 1.0 - n / rows)) : 0.0;
+    double t = tQuantile(n - 2) * correction;
+    fit->bInterval = t * fit->fit.baselineError;
+    fit->mInterval = t * fit->fit.slopeError;
+  }
+
+  // uniform
+  // Exit: uniform double in (0, 1), never 0 so its log is finite
+  static double uniform(std::mt19937_64 &random)
+  {
+    return ((random() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+  }
+
+  // ReservoirSampler
+  // Scanner sink keeping a uniform sample of the points seen so far, by
+  // Li's algorithm L: rather than a random draw per point it draws how
+  // many points to pass over before the next replacement, so past the
+  // first few reservoirs' worth a point costs a compare.
+  class ReservoirSampler {
+  public:
+    ReservoirSampler(size_t size) :
+      size_(std::max<size_t>(size, 1)), seen_(0), next_(0), w_(1.0),
+      random_(SEED), x_(0.0), xy_(false)
+    {
+      xs_.reserve(size_);
+      ys_.reserve(size_);
+    }
+
+    void operator()(double d)
+    {
+      if (xy_) {
+        add(x_, d);
+      } else {
+        x_ = d;
+      }
+      xy_ ^= true; // Toggle x/y
+    }
+
+    void add(double x, double y)
+    {
+      if (seen_ < size_) {
+        xs_.push_back(x);
+        ys_.push_back(y);
+        if (++seen_ == size_) {
+          w_ = exp(log(uniform(random_)) / size_);
+          next_ = seen_ - 1;
+          skip();
+        }
+        return;
+      }
+      if (seen_ == next_) {
+        size_t slot = random_() % size_;
+        xs_[slot] = x;
+        ys_[slot] = y;
+        w_ *= exp(log(uniform(random_)) / size_);
+        skip();
+      }
+      seen_++;
+    }
+
+    size_t seen() const { return seen_; }
+    const vector<double> &xs() const { return xs_; }
+    const vector<double> &ys() const { return ys_; }
+
+  private:
+    // skip
+    // Draw the index of the next point to go into the reservoir
+    void skip()
+    {
+      double gap = floor(log(uniform(random_)) / log1p(-w_)) + 1;
+      next_ = gap < 1e18 ? next_ + (size_t) gap : SIZE_MAX;
+    }
+
+    size_t size_;
+    size_t seen_;         // points offered so far
+    size_t next_;         // index of the next point to replace one
+    double w_;
+    std::mt19937_64 random_;
+    vector<double> xs_, ys_;
+    double x_;            // x waiting for its y
+    bool xy_;
+  };
+
+  bool sampleFile(const char *file, size_t size, SampledFit *fit)
+  {
+    ReservoirSampler sampler(size);
+    if (!scanFile(file, sampler)) {
+      return false;
+    }
+    STATS_TIMER(STATS_SUMS);
+    STATS_ADD(points, sampler.seen());
+    Sums sums;
+    if (!sampler.xs().empty()) {
+      hedger::getSums(&sampler.xs()[0], &sampler.ys()[0], sampler.xs().size(), &sums);
+    }
+    getIntervals(sums, sampler.seen(), fit);
+    return true;
+  }
+
+  // addRows
+  // Sum every stride-th row of a pair of columns
+  template <typename T>
+  static void addRows(const T *x, const T *y, size_t rows, size_t first, size_t stride, Sums *sums)
+  {
+    for (size_t i = first; i < rows; i += stride) {
+      sums->add(x[i], y[i]);
+    }
+  }
+
+  static void addRows(const ColumnFile &columns, size_t first, size_t stride, Sums *sums)
+  {
+    if (COLUMN_FLOAT32 == columns.type()) {
+      addRows(columns.x32(), columns.y32(), columns.size(), first, stride, sums);
+    } else {
+      addRows(columns.x64(), columns.y64(), columns.size(), first, stride, sums);
+    }
+  }
+
+  // sampleColumns
+  // The sample at stride s is every row ≡ o (mod s) for a start o drawn
+  // once, so the sample at s/2 is that one plus the rows ≡ o ± s/2, and
+  // refining reads each row at most once.  Strides spanning a page or
+  // more are read with random access so readahead leaves the rows
+  // between them on disk.
+  void sampleColumns(const ColumnFile &columns, size_t size, double target, SampledFit *fit)
+  {
+    STATS_TIMER(STATS_SUMS);
+    size_t rows = columns.size();
+    size_t width = COLUMN_FLOAT32 == columns.type() ? sizeof(float) : sizeof(double);
+    size_t page = std::max(1L, sysconf(_SC_PAGESIZE));
+    size = std::max<size_t>(size, 3);
+    size_t stride = 1;
+    while (stride <= rows / size / 2) {
+      stride *= 2;
+    }
+    std::mt19937_64 random(SEED);
+    size_t offset = random() % stride;
+
+    Sums sums;
+    columns.setAccess(stride * width < page);
+    addRows(columns, offset, stride, &sums);
+    for (;;) {
+      getIntervals(sums, rows, fit);
+      if (1 == stride || !(target > 0.0) || fit->mInterval <= target * fabs(fit->fit.m)) {
+        break;
+      }
+      size_t half = stride / 2;
+      columns.setAccess(half * width < page);
+      addRows(columns, (offset % stride + half) % stride, stride, &sums);
+      stride = half;
+    }
+    columns.setAccess(true);
+    STATS_ADD(points, sums.n);
+  }
+} // namespace hedger
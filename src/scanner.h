@@ -0,0 +1,447 @@
+// scanner.h
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+// Internal tokenizer shared by the file ingest paths.
+//
+
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+
+#include "compress.h"
+#include "regression.h"
+#include "stats.h"
+
+namespace hedger {
+  // InputFile
+  // Read-only access to the bytes of an input file.  Regular files are
+  // mapped whole so they can be scanned in place; pipes, terminals and
+  // anything else that cannot be mapped are read in large blocks instead.
+  // Compressed input is recognised by its magic and never mapped; reads
+  // return the decompressed stream.
+  class InputFile {
+  public:
+    InputFile() : fd_(-1), map_(NULL), size_(0), decompressor_(NULL), pending_(0) {}
+    ~InputFile() { close(); }
+
+    // open
+    // Entry: filename, or "-" for standard input
+    // Exit: true on success; false also for compressed input in a format
+    //       this build can not decompress
+    bool open(const char *file)
+    {
+      close();
+      if (!strcmp(file, "-")) {
+        fd_ = dup(STDIN_FILENO);
+      } else {
+        fd_ = ::open(file, O_RDONLY);
+      }
+      if (fd_ < 0) {
+        return false;
+      }
+      struct stat st;
+      if (!fstat(fd_, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (MAP_FAILED != p) {
+          map_ = static_cast<const char *>(p);
+          size_ = st.st_size;
+          madvise(p, size_, MADV_SEQUENTIAL);
+        }
+      }
+
+      // Sniff the format, from the mapping or from the first bytes read
+      Compression format;
+      if (map_) {
+        format = detectCompression(map_, std::min(size_, COMPRESSION_MAGIC));
+        if (COMPRESSION_NONE != format) {
+          munmap(const_cast<char *>(map_), size_);
+          map_ = NULL;
+          size_ = 0;
+          pending_ = 0;
+          if (lseek(fd_, 0, SEEK_SET)) {
+            close();
+            return false;
+          }
+        }
+      } else {
+        while (pending_ < COMPRESSION_MAGIC) {
+          ssize_t n = readRaw(head_ + pending_, COMPRESSION_MAGIC - pending_);
+          if (n < 0) {
+            close();
+            return false;
+          }
+          if (0 == n) {
+            break;
+          }
+          pending_ += n;
+        }
+        format = detectCompression(head_, pending_);
+      }
+      if (COMPRESSION_NONE != format) {
+        decompressor_ = Decompressor::create(format, fd_, head_, pending_);
+        pending_ = 0;
+        if (!decompressor_) {
+          close();
+          return false;
+        }
+      }
+      return true;
+    }
+
+    void close()
+    {
+      delete decompressor_;
+      decompressor_ = NULL;
+      pending_ = 0;
+      if (map_) {
+        munmap(const_cast<char *>(map_), size_);
+        map_ = NULL;
+        size_ = 0;
+      }
+      if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+      }
+    }
+
+    bool isMapped() const { return NULL != map_; }
+    bool isCompressed() const { return NULL != decompressor_; }
+    const char *data() const { return map_; }
+    size_t size() const { return size_; }
+
+    // read
+    // Read the next block of an unmapped file.
+    // Entry: destination buffer
+    //        capacity of buffer
+    // Exit: bytes read, 0 at end of file, -1 on error
+    ssize_t read(char *buf, size_t len)
+    {
+      if (decompressor_) {
+        return decompressor_->read(buf, len);
+      }
+      if (pending_ && len) {
+        // Bytes read while sniffing for compression
+        size_t n = std::min(len, pending_);
+        memcpy(buf, head_, n);
+        memmove(head_, head_ + n, pending_ - n);
+        pending_ -= n;
+        return n;
+      }
+      return readRaw(buf, len);
+    }
+
+    // readAll
+    // Read the rest of an unmapped file into memory, for passes that need
+    // random access to input that could not be mapped.
+    // Entry: destination buffer
+    // Exit: true on success
+    bool readAll(std::vector<char> *buffer)
+    {
+      const size_t READ_BLOCK = 1 << 20;
+      size_t used = buffer->size();
+      for (;;) {
+        buffer->resize(used + READ_BLOCK);
+        ssize_t n = read(&(*buffer)[used], READ_BLOCK);
+        if (n < 0) {
+          return false;
+        }
+        used += n;
+        if (0 == n) {
+          break;
+        }
+      }
+      buffer->resize(used);
+      return true;
+    }
+
+  private:
+    InputFile(const InputFile &);
+    InputFile &operator=(const InputFile &);
+
+    ssize_t readRaw(char *buf, size_t len)
+    {
+      ssize_t n;
+      do {
+        n = ::read(fd_, buf, len);
+      } while (n < 0 && EINTR == errno);
+      return n;
+    }
+
+    int fd_;
+    const char *map_;
+    size_t size_;
+    Decompressor *decompressor_;
+    char head_[COMPRESSION_MAGIC];  // first bytes of unmapped input
+    size_t pending_;                // of those, not yet returned by read
+  };
+
+  inline bool isDigit(char c) { return (unsigned char)(c - '0') < 10; }
+
+  // Characters that may begin a number; anything else is a separator.
+  inline bool isTokenStart(char c) { return isDigit(c) || '.' == c || '-' == c; }
+
+  // Characters that may continue a number once one has begun.
+  inline bool isTokenChar(char c)
+  {
+    return isTokenStart(c) || 'e' == c || 'E' == c || '+' == c;
+  }
+
+  // parseDouble
+  // Parse a decimal floating point number in place, without copying or
+  // consulting the locale.  Numbers of up to 19 significant digits whose
+  // decimal exponent is within ±22 are converted exactly with a single
+  // multiply or divide; anything longer is handed to strtod.
+  // Entry: pointer to first character
+  //        pointer one past the last character available
+  //        pointer to destination double
+  // Exit: pointer past the last character consumed, or the first
+  //       argument if no number could be read
+  const char *parseDouble(const char *p, const char *end, double *d);
+
+  // scanBuffer
+  // Tokenize a run of bytes, handing each number to sink.  Any character
+  // that can not start a number is a separator; a token that does not
+  // parse as a number is skipped.
+  // Entry: pointer to first character
+  //        pointer one past the last character
+  //        true if this is the end of input, false if more bytes follow
+  //        sink, called as sink(double) for every number
+  // Exit: pointer to the first unconsumed character.  Unless final, a
+  //       token touching the end of the buffer is left unconsumed as it
+  //       may continue in the next block.
+  template <typename Sink>
+  const char *scanBuffer(const char *p, const char *end, bool final, Sink &sink)
+  {
+    size_t tokens = 0, malformed = 0;
+    while (p < end) {
+      if (!isTokenStart(*p)) {
+        p++;
+        continue;
+      }
+      const char *tokenEnd = p + 1;
+      while (tokenEnd < end && isTokenChar(*tokenEnd)) {
+        tokenEnd++;
+      }
+      if (tokenEnd == end && !final) {
+        break;
+      }
+      double d;
+      if (parseDouble(p, tokenEnd, &d) != p) {
+        sink(d);
+        tokens++;
+      } else {
+        malformed++;
+      }
+      p = tokenEnd;
+    }
+    STATS_ADD(tokens, tokens);
+    STATS_ADD(malformed, malformed);
+    return p;
+  }
+
+  // Blanks, quotes and carriage returns padding a delimited field
+  inline bool isFieldPad(char c) { return ' ' == c || '\t' == c || '"' == c || '\r' == c; }
+
+  // parseField
+  // Parse a delimited field that must hold exactly one number
+  // Entry: pointer to first character of the field
+  //        pointer one past its last character
+  //        pointer to destination double
+  // Exit: true if the field is a number, give or take padding
+  inline bool parseField(const char *p, const char *end, double *d)
+  {
+    while (p < end && isFieldPad(*p)) {
+      p++;
+    }
+    const char *s = parseDouble(p, end, d);
+    if (s == p) {
+      return false;
+    }
+    while (s < end && isFieldPad(*s)) {
+      s++;
+    }
+    return s == end;
+  }
+
+  // scanFields
+  // Line oriented counterpart of scanBuffer for delimited text.  The two
+  // selected fields of each line go to sink as x then y; every other
+  // field is passed with memchr for its delimiter, and the rest of the
+  // line after the last selected field is not looked at.  Header lines,
+  // blank lines and lines missing either number produce nothing.
+  // Entry: pointer to first character, at the start of a line
+  //        pointer one past the last character
+  //        true if this is the end of input, false if more bytes follow
+  //        fields to pick
+  //        pointer to header lines still to skip, updated
+  //        sink, called as sink(double) twice for every line
+  // Exit: pointer to the first unconsumed character.  Unless final, a
+  //       line touching the end of the buffer is left unconsumed.
+  template <typename Sink>
+  const char *scanFields(const char *p, const char *end, bool final,
+      const Fields &fields, size_t *header, Sink &sink)
+  {
+    size_t tokens = 0, malformed = 0;
+    size_t last = std::max(fields.x, fields.y);
+    while (p < end) {
+      const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+      if (!eol) {
+        if (!final) {
+          break;
+        }
+        eol = end;
+      }
+      const char *next = eol < end ? eol + 1 : end;
+      if (*header) {
+        (*header)--;
+        p = next;
+        continue;
+      }
+
+      double x = 0.0, y = 0.0;
+      bool ok = true;
+      const char *field = p;
+      for (size_t k = 0; ok && k <= last; k++) {
+        const char *fieldEnd = static_cast<const char *>(memchr(field, fields.delimiter, eol - field));
+        if (!fieldEnd) {
+          fieldEnd = eol;
+        }
+        if (k == fields.x) {
+          ok = parseField(field, fieldEnd, &x);
+        }
+        if (ok && k == fields.y) {
+          ok = parseField(field, fieldEnd, &y);
+        }
+        if (fieldEnd == eol && k < last) {
+          ok = false;
+        }
+        field = fieldEnd + 1;
+      }
+      if (ok) {
+        sink(x);
+        sink(y);
+        tokens += 2;
+      } else if (eol - p > 1 || (eol > p && '\r' != *p)) {
+        malformed++;
+      }
+      p = next;
+    }
+    STATS_ADD(tokens, tokens);
+    STATS_ADD(malformed, malformed);
+    return p;
+  }
+
+  // scanBlocks
+  // Run a block scanner over the rest of an open input, in place if it
+  // is mapped, otherwise through a block buffer.
+  // Entry: open input
+  //        scanner, called as scan(begin, end, final) and returning the
+  //        first unconsumed character, as scanBuffer does
+  // Exit: true on success
+  template <typename Scan>
+  bool scanBlocks(InputFile &in, const Scan &scan)
+  {
+    const size_t READ_BLOCK = 1 << 20;
+    STATS_TIMER(STATS_PARSE);
+    if (in.isMapped()) {
+      STATS_ADD(bytes, in.size());
+      scan(in.data(), in.data() + in.size(), true);
+      return true;
+    }
+
+    std::vector<char> buffer(READ_BLOCK);
+    size_t carry = 0;   // bytes of a partial token or line from the last block
+    for (;;) {
+      ssize_t n = in.read(&buffer[carry], buffer.size() - carry);
+      if (n < 0) {
+        return false;
+      }
+      STATS_ADD(bytes, n);
+      const char *begin = &buffer[0];
+      const char *end = begin + carry + n;
+      const char *rest = scan(begin, end, 0 == n);
+      if (0 == n) {
+        break;
+      }
+      carry = end - rest;
+      if (carry == buffer.size()) {
+        // Error; a single token or line filled the whole block
+        return false;
+      }
+      memmove(&buffer[0], rest, carry);
+    }
+    return true;
+  }
+
+  // scanInput
+  // Tokenize the rest of an open input.
+  // Entry: open input
+  //        sink, called as sink(double) for every number
+  // Exit: true on success
+  template <typename Sink>
+  bool scanInput(InputFile &in, Sink &sink)
+  {
+    return scanBlocks(in, [&sink](const char *begin, const char *end, bool final) {
+      return scanBuffer(begin, end, final, sink);
+    });
+  }
+
+  // scanInput
+  // Scan the selected fields of every line of an open input.
+  // Entry: open input
+  //        fields to pick
+  //        sink, called as sink(double) for x and again for y
+  // Exit: true on success
+  template <typename Sink>
+  bool scanInput(InputFile &in, const Fields &fields, Sink &sink)
+  {
+    size_t header = fields.header;
+    return scanBlocks(in, [&sink, &fields, &header](const char *begin, const char *end, bool final) {
+      return scanFields(begin, end, final, fields, &header, sink);
+    });
+  }
+
+  // scanFile
+  // Open and tokenize a whole file.
+  // Entry: filename, or "-" for standard input
+  //        sink, called as sink(double) for every number
+  // Exit: true on success
+  template <typename Sink>
+  bool scanFile(const char *file, Sink &sink)
+  {
+    InputFile in;
+    {
+      STATS_TIMER(STATS_OPEN);
+      if (!in.open(file)) {
+        return false;
+      }
+    }
+    return scanInput(in, sink);
+  }
+} // namespace hedger
+
+#endif // SCANNER_H
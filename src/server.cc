@@ -0,0 +1,353 @@
+// server.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+// Persistent fit server: framed requests over a Unix or TCP socket.
+//
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "regression.h"
+#include "scanner.h"
+#include "stats.h"
+
+using namespace std;
+
+namespace hedger {
+  // Payload bytes a worker holds at a time; larger payloads are summed as
+  // they arrive, a chunk at a time
+  static const size_t SERVE_CHUNK = 1 << 20;
+
+  // ConnectionQueue
+  // Accepted connections waiting for a worker; -1 tells a worker to stop.
+  class ConnectionQueue {
+  public:
+    void push(int fd)
+    {
+      {
+        lock_guard<mutex> lock(mutex_);
+        fds_.push_back(fd);
+      }
+      ready_.notify_one();
+    }
+    int pop()
+    {
+      unique_lock<mutex> lock(mutex_);
+      while (fds_.empty()) {
+        ready_.wait(lock);
+      }
+      int fd = fds_.front();
+      fds_.pop_front();
+      return fd;
+    }
+  private:
+    mutex mutex_;
+    condition_variable ready_;
+    deque<int> fds_;
+  };
+
+  // ServeSumsSink
+  // Scanner sink folding alternating x and y into sums.
+  struct ServeSumsSink {
+    ServeSumsSink() : x(0.0), xy(false) {}
+    void operator()(double d)
+    {
+      if (xy) {
+        sums.add(x, d);
+      } else {
+        x = d;
+      }
+      xy ^= true; // Toggle x/y
+    }
+    Sums sums;
+    double x;   // x waiting for its y
+    bool xy;
+  };
+
+  // readFully
+  // Exit: true once size bytes are read, false on error, end of stream or
+  //       the idle timeout
+  static bool readFully(int fd, void *buffer, size_t size)
+  {
+    char *p = static_cast<char *>(buffer);
+    while (size) {
+      ssize_t n = recv(fd, p, size, 0);
+      if (n < 0 && EINTR == errno) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      p += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  static bool writeFully(int fd, const void *buffer, size_t size)
+  {
+    const char *p = static_cast<const char *>(buffer);
+    while (size) {
+      ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+      if (n < 0 && EINTR == errno) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      p += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  // sumPayload
+  // Receive a payload a chunk at a time, summing each as it arrives.  A
+  // CSV token cut by the end of a chunk is moved to the front of the
+  // buffer and completed by the next read.  A bad payload is still read
+  // through, so the next request on the connection is found.
+  // Entry: connected socket
+  //        request, its payload not yet read
+  //        worker's buffer, of up to SERVE_CHUNK bytes
+  //        pointer to destination sums
+  //        pointer to response status, set if the payload is bad
+  // Exit: false if the connection failed within the payload
+  static bool sumPayload(int fd, const ServeRequest &request, vector<DataPoint> *buffer,
+      Sums *sums, uint32_t *status)
+  {
+    size_t bytes = std::min<uint64_t>(request.length, SERVE_CHUNK);
+    size_t points = (bytes + sizeof(DataPoint) - 1) / sizeof(DataPoint);
+    if (buffer->size() < points) {
+      buffer->resize(points);
+    }
+    char *text = reinterpret_cast<char *>(buffer->data());
+    size_t room = buffer->size() * sizeof(DataPoint);
+    bool binary = SERVE_BINARY == request.format && 0 == request.length % sizeof(DataPoint);
+    bool csv = SERVE_CSV == request.format;
+    if (!binary && !csv) {
+      *status = SERVE_BAD_REQUEST;
+    }
+
+    ServeSumsSink sink;
+    size_t carry = 0;
+    for (uint64_t left = request.length; left;) {
+      size_t n = std::min<uint64_t>(left, room - carry);
+      if (!readFully(fd, text + carry, n)) {
+        return false;
+      }
+      left -= n;
+      if (binary) {
+        Sums part;
+        getSums(buffer->data(), n / sizeof(DataPoint), &part);
+        sums->merge(part);
+      } else if (csv && SERVE_OK == *status) {
+        const char *end = text + carry + n;
+        const char *rest = scanBuffer(text, end, 0 == left, sink);
+        carry = end - rest;
+        if (carry == room) {
+          // One token as long as the whole buffer
+          *status = SERVE_BAD_REQUEST;
+          carry = 0;
+        }
+        memmove(text, rest, carry);
+      }
+    }
+    if (csv) {
+      *sums = sink.sums;
+    }
+    return true;
+  }
+
+  // serveConnection
+  // Answer requests on one connection until the client hangs up or is
+  // idle for SERVE_IDLE_SECONDS, which frees the worker for connections
+  // still queued.  The payload buffer belongs to the worker and is
+  // reused, and never grows past SERVE_CHUNK however large a request is:
+  // binary points are summed where they were received, CSV is tokenized
+  // in place.
+  // Entry: connected socket, closed on return
+  //        worker's payload buffer
+  static void serveConnection(int fd, vector<DataPoint> *buffer)
+  {
+    struct timeval idle;
+    idle.tv_sec = SERVE_IDLE_SECONDS;
+    idle.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &idle, sizeof(idle));
+
+    ServeRequest request;
+    while (readFully(fd, &request, sizeof(request))) {
+      ServeResponse response;
+      memset(&response, 0, sizeof(response));
+      if (request.length > SERVE_MAX_PAYLOAD) {
+        response.status = SERVE_TOO_LARGE;
+        writeFully(fd, &response, sizeof(response));
+        break;
+      }
+      Sums sums;
+      if (!sumPayload(fd, request, buffer, &sums, &response.status)) {
+        break;
+      }
+      STATS_ADD(bytes, request.length);
+
+      if (SERVE_OK == response.status) {
+        if (sums.n < 2) {
+          response.status = SERVE_TOO_FEW;
+        } else {
+          Fit fit;
+          getFit(sums, &fit);
+          response.count = sums.n;
+          response.m = fit.m;
+          response.b = fit.b;
+          response.xMean = fit.xMean;
+          STATS_ADD(points, sums.n);
+        }
+      }
+      if (!writeFully(fd, &response, sizeof(response))) {
+        break;
+      }
+    }
+    close(fd);
+  }
+
+  // listenOn
+  // Entry: Unix socket path, or "tcp:host:port"
+  // Exit: listening socket, or -1
+  static int listenOn(const char *address)
+  {
+    int fd = -1;
+    if (!strncmp(address, "tcp:", 4)) {
+      string hostPort(address + 4);
+      size_t colon = hostPort.rfind(':');
+      if (string::npos == colon) {
+        return -1;
+      }
+      string host = hostPort.substr(0, colon), port = hostPort.substr(colon + 1);
+      struct addrinfo hints, *addresses = NULL;
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+      hints.ai_flags = AI_PASSIVE;
+      if (getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &addresses)) {
+        return -1;
+      }
+      for (struct addrinfo *a = addresses; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) {
+          continue;
+        }
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, a->ai_addr, a->ai_addrlen)) {
+          close(fd);
+          fd = -1;
+        }
+      }
+      freeaddrinfo(addresses);
+    } else {
+      struct sockaddr_un un;
+      memset(&un, 0, sizeof(un));
+      un.sun_family = AF_UNIX;
+      if (strlen(address) >= sizeof(un.sun_path)) {
+        return -1;
+      }
+      strcpy(un.sun_path, address);
+      fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (fd < 0) {
+        return -1;
+      }
+      unlink(address);
+      if (bind(fd, (struct sockaddr *) &un, sizeof(un))) {
+        close(fd);
+        return -1;
+      }
+    }
+    if (fd >= 0 && listen(fd, SOMAXCONN)) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  // serve
+  // Accept on the calling thread and hand each connection to the next
+  // free worker, which answers its pipelined requests in order.  With
+  // more open connections than workers, the extra connections wait.
+  bool serve(const char *address, unsigned threads)
+  {
+    int listener = listenOn(address);
+    if (listener < 0) {
+      return false;
+    }
+    bool tcp = !strncmp(address, "tcp:", 4);
+    if (!threads) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    ConnectionQueue queue;
+    vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; i++) {
+      workers.push_back(std::thread([&queue]() {
+        vector<DataPoint> buffer;
+        for (int fd = queue.pop(); fd >= 0; fd = queue.pop()) {
+          serveConnection(fd, &buffer);
+        }
+      }));
+    }
+    for (;;) {
+      int fd = accept(listener, NULL, NULL);
+      if (fd < 0) {
+        if (EINTR == errno || ECONNABORTED == errno) {
+          continue;
+        }
+        break;
+      }
+      if (tcp) {
+        // Responses are small; send each as soon as it is ready
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+      }
+      queue.push(fd);
+    }
+    // accept failed for good; let the workers finish their connections
+    close(listener);
+    for (size_t i = 0; i < workers.size(); i++) {
+      queue.push(-1);
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+      workers[i].join();
+    }
+    return false;
+  }
+} // namespace hedger
@@ -0,0 +1,67 @@
+// stats.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+
+#include <inttypes.h>
+
+#include "stats.h"
+
+namespace hedger {
+  // Static storage, so every counter starts at zero
+  Stats stats;
+
+  static const char *PHASE_NAMES[STATS_PHASES] = {
+    "open", "parse", "copy", "sums", "output"
+  };
+
+  bool statsEnabled()
+  {
+#ifdef REGRESSION_STATS
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void printStats(FILE *f, bool json, double seconds)
+  {
+    uint64_t points = stats.points;
+    double rate = seconds > 0.0 ? points / seconds : 0.0;
+    if (json) {
+      fprintf(f, "{");
+      for (int i = 0; i < STATS_PHASES; i++) {
+        fprintf(f, "\"%s_s\":%.9f,", PHASE_NAMES[i], stats.nanoseconds[i] * 1e-9);
+      }
+      fprintf(f, "\"total_s\":%.9f,\"bytes\":%" PRIu64 ",\"tokens\":%" PRIu64
+        ",\"malformed\":%" PRIu64 ",\"points\":%" PRIu64 ",\"points_per_s\":%.1f}\n",
+        seconds, (uint64_t) stats.bytes, (uint64_t) stats.tokens,
+        (uint64_t) stats.malformed, points, rate);
+      return;
+    }
+    for (int i = 0; i < STATS_PHASES; i++) {
+      fprintf(f, "%-10s %12.6f s\n", PHASE_NAMES[i], stats.nanoseconds[i] * 1e-9);
+    }
+    fprintf(f, "%-10s %12.6f s\n", "total", seconds);
+    fprintf(f, "%-10s %12" PRIu64 "\n", "bytes", (uint64_t) stats.bytes);
+    fprintf(f, "%-10s %12" PRIu64 "\n", "tokens", (uint64_t) stats.tokens);
+    fprintf(f, "%-10s %12" PRIu64 "\n", "malformed", (uint64_t) stats.malformed);
+    fprintf(f, "%-10s %12" PRIu64 "\n", "points", points);
+    fprintf(f, "%-10s %12.0f\n", "points/s", rate);
+  }
+} // namespace hedger
@@ -0,0 +1,105 @@
+// weighted.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+// Weighted least squares fits from {x,y,w} triples.
+//
+
+#include "regression.h"
+#include "scanner.h"
+#include "stats.h"
+
+namespace hedger {
+  // WeightedCollector
+  // Scanner sink gathering numbers three at a time into column blocks for
+  // getWeightedSums.  A trailing incomplete triple is dropped, as an
+  // unpaired x is in two column input.
+  struct WeightedCollector {
+    static const size_t BLOCK = 1024;
+
+    WeightedCollector(WeightedSums *sums) : sums(sums), size(0), column(0) {}
+    void operator()(double d)
+    {
+      switch (column) {
+      case 0:
+        x[size] = d;
+        column = 1;
+        break;
+      case 1:
+        y[size] = d;
+        column = 2;
+        break;
+      default:
+        w[size++] = d;
+        column = 0;
+        if (BLOCK == size) {
+          flush();
+        }
+        break;
+      }
+    }
+    void flush()
+    {
+      STATS_TIMER(STATS_SUMS);
+      WeightedSums part;
+      getWeightedSums(x, y, w, size, &part);
+      sums->merge(part);
+      size = 0;
+    }
+    WeightedSums *sums;
+    double x[BLOCK];
+    double y[BLOCK];
+    double w[BLOCK];
+    size_t size;
+    int column;   // which of x, y, w comes next
+  };
+
+  bool streamWeightedFile(const char *file, WeightedSums *sums)
+  {
+    WeightedCollector collector(sums);
+    if (!scanFile(file, collector)) {
+      return false;
+    }
+    collector.flush();
+    return true;
+  }
+
+  // getFit
+  // Weighted least squares from weighted sums.  The closed forms are the
+  // ordinary ones with N replaced by Σw and every sigma weighted, and x̄
+  // and ȳ become weighted means.
+  // Entry: weighted sums
+  //        pointer to destination fit
+  void getFit(const WeightedSums &sums, Fit *fit)
+  {
+    fit->sums.n = sums.n;
+    fit->sums.x = sums.x;
+    fit->sums.y = sums.y;
+    fit->sums.xSquared = sums.xSquared;
+    fit->sums.xy = sums.xy;
+    fit->sums.ySquared = sums.ySquared;
+    fit->xMean = sums.x / sums.w;
+    fit->yMean = sums.y / sums.w;
+    double sxx = sums.xSquared - sums.x * fit->xMean;
+    double sxy = sums.xy - sums.x * fit->yMean;
+    fit->m = sxy / sxx;
+    fit->b = fit->yMean - fit->m * fit->xMean;
+    fit->yAtMean = fit->m * fit->xMean + fit->b;
+    getFitStatistics(sums.n, sums.w, sxx, sums.ySquared - sums.y * fit->yMean, sxy, fit);
+  }
+} // namespace hedger
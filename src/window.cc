@@ -0,0 +1,83 @@
+// window.cc
+//
+// This file is part of regression.
+//
+// Regression is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Regression is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with regression.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Greg Hedger
+//
+
+#include "regression.h"
+
+namespace hedger {
+  // WindowFit
+  // Entry: # of points in the window
+  //        steps between full re-summations, 0 for one per window length
+  WindowFit::WindowFit(size_t window, size_t resumInterval)
+    : ring_(window ? window : 1), head_(0), count_(0),
+      resumInterval_(resumInterval ? resumInterval : ring_.size()),
+      sinceResum_(0)
+  {
+  }
+
+  // add
+  // Push a point into the window, evicting the oldest once it is full.
+  void WindowFit::add(double x, double y)
+  {
+    DataPoint &slot = ring_[head_];
+    if (full()) {
+      sums_.remove(slot.x, slot.y);
+    } else {
+      count_++;
+    }
+    slot.x = x;
+    slot.y = y;
+    sums_.add(x, y);
+    if (++head_ == ring_.size()) {
+      head_ = 0;
+    }
+    if (++sinceResum_ >= resumInterval_) {
+      resum();
+    }
+  }
+
+  void WindowFit::clear()
+  {
+    head_ = 0;
+    count_ = 0;
+    sinceResum_ = 0;
+    sums_ = Sums();
+  }
+
+  // resum
+  // Recompute the sums from the points in the ring.  Order does not matter
+  // to the sums, so the occupied prefix is summed in one kernel call.
+  void WindowFit::resum()
+  {
+    sinceResum_ = 0;
+    size_t filled = full() ? ring_.size() : head_;
+    getSums(&ring_[0], filled, &sums_);
+  }
+
+  void WindowFit::getBestFit(double *b, double *m) const
+  {
+    hedger::getBestFit(sums_, b, m);
+  }
+
+  void WindowFit::getFit(Fit *fit) const
+  {
+    hedger::getFit(sums_, fit);
+  }
+
+} // namespace hedger